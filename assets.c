@@ -0,0 +1,286 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Shared texture cache
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** Every texture used by the game is loaded through here, keyed by its
+** path. The first request decodes and uploads the image; later requests
+** just bump the reference count and hand back the same handle, so a level
+** full of walls only ever has one wall texture on the GPU.
+**
+** Handles are individually allocated, so they stay valid while the table
+** around them grows or shrinks.
+*/
+static struct Asset **assets = NULL;
+static int assetCount = 0;
+static int assetCapacity = 0;
+
+/*
+** Every image the game ships with, decoded in parallel by assetsPreload
+** at startup and pinned in the cache from then on.
+*/
+static const char *assetManifest[] = {
+	"res/tank.png",
+	"res/ui/btn.png",
+	"res/ui/fbtn.png",
+	"res/ui/mm/circle.png",
+	"res/ent/wall.png",
+	"res/lvl/move.png",
+	"res/lvl/prompt.png",
+};
+
+struct PreloadJob {
+	SDL_atomic_t next;
+	int count;
+	const char **paths;
+	struct SDL_Surface **surfaces;
+};
+
+static int assetFind(const char *path) {
+	for (int i = 0; i < assetCount; i++) {
+		if (strcmp(assets[i]->path, path) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Takes ownership of the surface, which is freed once uploaded */
+static struct Asset *assetCreate(const char *path, SDL_Surface *surf) {
+	if (assetCount == assetCapacity) {
+		assetCapacity = assetCapacity ? assetCapacity * 2 : 16;
+		assets = realloc(assets, sizeof(struct Asset *) * assetCapacity);
+		if (!assets) {
+			puts("E: Out of memory while growing texture cache");
+			exit(1);
+		}
+	}
+
+	struct Asset *asset = malloc(sizeof(struct Asset));
+	if (!asset) {
+		puts("E: Out of memory while loading texture");
+		exit(1);
+	}
+
+	asset->path = malloc(strlen(path) + 1);
+	strcpy(asset->path, path);
+
+	asset->pixels = NULL;
+	asset->spriteCount = 0;
+	asset->sprites = NULL;
+	softAdopt(asset, surf);
+
+	asset->texture = SDL_CreateTextureFromSurface(renderer, surf);
+	asset->w = surf->w;
+	asset->h = surf->h;
+	SDL_FreeSurface(surf);
+
+	if (!asset->texture) {
+		printf("E: Failed to upload texture \"%s\"\nError message: %s\n", path,
+			   SDL_GetError());
+		exit(1);
+	}
+
+	asset->refs = 1;
+	asset->pinned = false;
+
+	assets[assetCount++] = asset;
+	return asset;
+}
+
+struct Asset *assetAcquire(const char *path) {
+	int index = assetFind(path);
+	if (index >= 0) {
+		assets[index]->refs++;
+		return assets[index];
+	}
+
+	return assetCreate(path, loadTexture(path));
+}
+
+/*
+** As assetAcquire, but for an image someone else has already decoded,
+** such as a loader thread. The surface is always consumed; if the path is
+** already cached it is simply thrown away.
+*/
+struct Asset *assetAcquireSurface(const char *path, struct SDL_Surface *surf) {
+	int index = assetFind(path);
+	if (index >= 0) {
+		SDL_FreeSurface(surf);
+		assets[index]->refs++;
+		return assets[index];
+	}
+
+	return assetCreate(path, surf);
+}
+
+void assetRetain(struct Asset *asset) {
+	asset->refs++;
+}
+
+/*
+** Re-reads a cached image from its source and swaps the new texture into
+** the existing handle, so everything holding it draws the new one. A
+** broken image leaves the old texture alone. Not cached means nobody is
+** using it, so there's nothing to do.
+*/
+bool assetReload(const char *path) {
+	int index = assetFind(path);
+	if (index < 0)
+		return false;
+
+	SDL_RWops *rw = packOpenRW(path);
+	SDL_Surface *surf = rw ? IMG_Load_RW(rw, 1) : NULL;
+	if (!surf) {
+		printf("W: Could not reload texture \"%s\": %s\n", path,
+			   IMG_GetError());
+		return false;
+	}
+
+	surf = texCacheStore(path, surf);
+
+	SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surf);
+	int w = surf->w, h = surf->h;
+
+	if (!texture) {
+		printf("W: Could not upload reloaded texture \"%s\": %s\n", path,
+			   SDL_GetError());
+		SDL_FreeSurface(surf);
+		return false;
+	}
+
+	struct Asset *asset = assets[index];
+	softAdopt(asset, surf);
+	SDL_FreeSurface(surf);
+
+	SDL_DestroyTexture(asset->texture);
+	asset->texture = texture;
+	asset->w = w;
+	asset->h = h;
+
+	return true;
+}
+
+bool assetCached(const char *path) {
+	return assetFind(path) >= 0;
+}
+
+/* Each decoder takes the next undecoded image until there are none left */
+static void preloadDecode(struct PreloadJob *job) {
+	for (;;) {
+		int i = SDL_AtomicAdd(&job->next, 1);
+		if (i >= job->count)
+			return;
+
+		/* A failure is reported after the join; see assetsPreload */
+		job->surfaces[i] = decodeTexture(job->paths[i]);
+	}
+}
+
+static int preloadWorker(void *data) {
+	traceThreadName("image decoder");
+	preloadDecode(data);
+
+	return 0;
+}
+
+/*
+** Decodes the whole manifest across a few threads, then uploads it all on
+** this one, which must be the render thread. Everything loaded is pinned,
+** so later acquires are just a lookup.
+*/
+void assetsPreload() {
+	traceBegin("assetsPreload");
+
+	struct PreloadJob job;
+	struct SDL_Surface *surfaces[sizeof(assetManifest) /
+								 sizeof(assetManifest[0])];
+
+	SDL_AtomicSet(&job.next, 0);
+	job.count = sizeof(assetManifest) / sizeof(assetManifest[0]);
+	job.paths = assetManifest;
+	job.surfaces = surfaces;
+
+	int workers = SDL_min(SDL_GetCPUCount(), ASSET_MAX_DECODERS);
+	workers = SDL_min(workers, job.count);
+
+	/* This thread decodes too, so one fewer needs creating */
+	struct SDL_Thread *threads[ASSET_MAX_DECODERS];
+	int started = 0;
+	for (int i = 1; i < workers; i++) {
+		threads[started] =
+			SDL_CreateThread(preloadWorker, "imageDecoder", &job);
+		if (threads[started])
+			started++;
+	}
+
+	preloadDecode(&job);
+	for (int i = 0; i < started; i++)
+		SDL_WaitThread(threads[i], NULL);
+
+	for (int i = 0; i < job.count; i++) {
+		if (!surfaces[i]) {
+			printf("E: Missing texture detected: \"%s\"\n", job.paths[i]);
+			exit(-1);
+		}
+
+		struct Asset *asset = assetAcquireSurface(job.paths[i], surfaces[i]);
+		asset->pinned = true;
+		assetRelease(asset);
+	}
+
+	traceEnd("assetsPreload");
+}
+
+void assetRelease(struct Asset *asset) {
+	if (!asset)
+		return;
+
+	asset->refs--;
+	if (asset->refs > 0 || asset->pinned)
+		return;
+
+	int index = assetFind(asset->path);
+	if (index >= 0)
+		assets[index] = assets[--assetCount];
+
+	SDL_DestroyTexture(asset->texture);
+	softForget(asset);
+	free(asset->path);
+	free(asset);
+}
+
+void assetsDestroy() {
+	for (int i = 0; i < assetCount; i++) {
+		if (assets[i]->refs > 0)
+			printf("DEBUG: Texture \"%s\" still held %i time(s) at exit\n",
+				   assets[i]->path, assets[i]->refs);
+
+		SDL_DestroyTexture(assets[i]->texture);
+		softForget(assets[i]);
+		free(assets[i]->path);
+		free(assets[i]);
+	}
+
+	free(assets);
+	assets = NULL;
+	assetCount = 0;
+	assetCapacity = 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Sprite batching routines
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** Sprites are collected into one vertex list per texture and submitted
+** with a single SDL_RenderGeometry call each when the batch is flushed.
+** Textures are drawn in the order they were first added, so sprites
+** sharing a texture must not need to interleave with other textures.
+**
+** Buffers are kept between frames and only ever grow, so a steady scene
+** does no allocation at all.
+*/
+struct SpriteBucket {
+	struct SDL_Texture *texture;
+	float texW, texH;
+
+	int quadCount;
+	int quadCapacity;
+	SDL_Vertex *verts;
+};
+
+static struct SpriteBucket buckets[BATCH_MAX_TEXTURES];
+static int bucketCount = 0;
+
+static int *indices = NULL;
+static int indexQuads = 0;
+
+static const SDL_Color white = {255, 255, 255, 255};
+
+static void growIndices(int quads) {
+	if (quads <= indexQuads)
+		return;
+
+	int newQuads = indexQuads ? indexQuads : 256;
+	while (newQuads < quads)
+		newQuads *= 2;
+
+	indices = realloc(indices, sizeof(int) * 6 * newQuads);
+	if (!indices) {
+		puts("E: Out of memory while growing sprite batch");
+		exit(1);
+	}
+
+	/* Every quad is two triangles over its own four vertices */
+	for (int i = indexQuads; i < newQuads; i++) {
+		indices[i * 6 + 0] = i * 4 + 0;
+		indices[i * 6 + 1] = i * 4 + 1;
+		indices[i * 6 + 2] = i * 4 + 2;
+		indices[i * 6 + 3] = i * 4 + 2;
+		indices[i * 6 + 4] = i * 4 + 3;
+		indices[i * 6 + 5] = i * 4 + 0;
+	}
+
+	indexQuads = newQuads;
+}
+
+static struct SpriteBucket *findBucket(struct SDL_Texture *texture) {
+	for (int i = 0; i < bucketCount; i++) {
+		if (buckets[i].texture == texture)
+			return &buckets[i];
+	}
+
+	/* Out of buckets; make room by drawing what we have so far */
+	if (bucketCount == BATCH_MAX_TEXTURES)
+		batchFlush();
+
+	/* Reuse the slot's old vertex buffer if it had one */
+	struct SpriteBucket *bucket = &buckets[bucketCount++];
+	bucket->texture = texture;
+	bucket->quadCount = 0;
+
+	int w = 1, h = 1;
+	SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+	bucket->texW = (float)w;
+	bucket->texH = (float)h;
+
+	return bucket;
+}
+
+/* Room for one more quad in the texture's bucket */
+static SDL_Vertex *reserveQuad(struct SpriteBucket *bucket) {
+	if (bucket->quadCount == bucket->quadCapacity) {
+		bucket->quadCapacity =
+			bucket->quadCapacity ? bucket->quadCapacity * 2 : 64;
+		bucket->verts = realloc(bucket->verts, sizeof(SDL_Vertex) * 4 *
+												   bucket->quadCapacity);
+		if (!bucket->verts) {
+			puts("E: Out of memory while growing sprite batch");
+			exit(1);
+		}
+	}
+
+	return &bucket->verts[bucket->quadCount++ * 4];
+}
+
+void batchBegin() {
+	for (int i = 0; i < bucketCount; i++)
+		buckets[i].quadCount = 0;
+
+	bucketCount = 0;
+}
+
+void batchAdd(struct Asset *texture, const SDL_Rect *place, double angle) {
+	/* In software, sprites are cheapest drawn straight away */
+	if (softEnabled()) {
+		SDL_FRect dst = {place->x, place->y, place->w, place->h};
+		softDraw(texture, &dst, angle);
+		return;
+	}
+
+	SDL_Vertex *v = reserveQuad(findBucket(texture->texture));
+
+	/* Rotate clockwise about the centre, as SDL_RenderCopyEx would */
+	float hw = place->w / 2.0f;
+	float hh = place->h / 2.0f;
+	float cx = place->x + hw;
+	float cy = place->y + hh;
+
+	float c = 1.0f, s = 0.0f;
+	if (angle != 0.0) {
+		double rad = angle * M_PI / 180.0;
+		c = (float)cos(rad);
+		s = (float)sin(rad);
+	}
+
+	static const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+	for (int i = 0; i < 4; i++) {
+		float dx = corners[i][0] * hw;
+		float dy = corners[i][1] * hh;
+
+		v[i].position.x = cx + dx * c - dy * s;
+		v[i].position.y = cy + dx * s + dy * c;
+		v[i].color = white;
+		v[i].tex_coord.x = corners[i][0] > 0 ? 1.0f : 0.0f;
+		v[i].tex_coord.y = corners[i][1] > 0 ? 1.0f : 0.0f;
+	}
+}
+
+/* An unrotated, tinted part of a texture, as used for glyphs */
+void batchAddRegion(struct SDL_Texture *texture, const SDL_Rect *src,
+					const SDL_FRect *dst, SDL_Color color) {
+	struct SpriteBucket *bucket = findBucket(texture);
+	SDL_Vertex *v = reserveQuad(bucket);
+
+	float u0 = src->x / bucket->texW;
+	float v0 = src->y / bucket->texH;
+	float u1 = (src->x + src->w) / bucket->texW;
+	float v1 = (src->y + src->h) / bucket->texH;
+
+	v[0].position = (SDL_FPoint){dst->x, dst->y};
+	v[1].position = (SDL_FPoint){dst->x + dst->w, dst->y};
+	v[2].position = (SDL_FPoint){dst->x + dst->w, dst->y + dst->h};
+	v[3].position = (SDL_FPoint){dst->x, dst->y + dst->h};
+
+	v[0].tex_coord = (SDL_FPoint){u0, v0};
+	v[1].tex_coord = (SDL_FPoint){u1, v0};
+	v[2].tex_coord = (SDL_FPoint){u1, v1};
+	v[3].tex_coord = (SDL_FPoint){u0, v1};
+
+	for (int i = 0; i < 4; i++)
+		v[i].color = color;
+}
+
+void batchFlush() {
+	for (int i = 0; i < bucketCount; i++) {
+		struct SpriteBucket *bucket = &buckets[i];
+		if (!bucket->quadCount)
+			continue;
+
+		growIndices(bucket->quadCount);
+		SDL_RenderGeometry(renderer, bucket->texture, bucket->verts,
+						   bucket->quadCount * 4, indices,
+						   bucket->quadCount * 6);
+	}
+
+	batchBegin();
+}
+
+void batchDestroy() {
+	for (int i = 0; i < BATCH_MAX_TEXTURES; i++) {
+		free(buckets[i].verts);
+		buckets[i].verts = NULL;
+		buckets[i].quadCapacity = 0;
+	}
+
+	free(indices);
+	indices = NULL;
+	indexQuads = 0;
+	bucketCount = 0;
+}
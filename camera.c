@@ -0,0 +1,48 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Camera routines
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** Levels and everything on them live in world coordinates, which can run
+** on for many screens. The camera is the part of the world on screen: a
+** rect the size of the logical screen, in world coordinates, so drawing
+** something is just a matter of subtracting the camera's corner.
+**
+** It keeps the player in the middle of the screen, but never shows past
+** the edges of the level. A level smaller than the screen stays put in
+** the top left corner, as levels always used to be drawn.
+*/
+static int cameraClamp(int pos, int view, int world) {
+	if (pos > world - view)
+		pos = world - view;
+
+	return pos > 0 ? pos : 0;
+}
+
+/* Centres the camera on a point in a world this big */
+void cameraFollow(SDL_Rect *camera, int worldW, int worldH, float x, float y) {
+	scaleLogicalSize(&camera->w, &camera->h);
+
+	camera->x = cameraClamp((int)lroundf(x - camera->w / 2.0f), camera->w,
+							worldW);
+	camera->y = cameraClamp((int)lroundf(y - camera->h / 2.0f), camera->h,
+							worldH);
+}
+
+void cameraToWorld(const SDL_Rect *camera, int x, int y, int *worldX,
+				   int *worldY) {
+	*worldX = x + camera->x;
+	*worldY = y + camera->y;
+}
@@ -0,0 +1,246 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Spatial index routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** A spatial hash over fixed GRID_CELL_SIZE cells. Each item is linked into
+** every cell its bounds touch, so a query only visits the handful of
+** cells under the area being asked about, however large the level is.
+**
+** Cells are hashed rather than stored in a flat array, so levels have no
+** fixed size and may use negative coordinates. Entries live in one pool
+** and are chained per bucket by index; removed entries go on a free list
+** and are reused by the next insert.
+*/
+#define GRID_NIL -1
+
+static int floorDiv(int a, int b) {
+	int q = a / b;
+	if ((a % b != 0) && ((a < 0) != (b < 0)))
+		q--;
+
+	return q;
+}
+
+static uint32_t cellHash(int32_t cx, int32_t cy) {
+	return ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+}
+
+static void cellRange(const SDL_Rect *r, int *x0, int *y0, int *x1, int *y1) {
+	*x0 = floorDiv(r->x, GRID_CELL_SIZE);
+	*y0 = floorDiv(r->y, GRID_CELL_SIZE);
+	*x1 = floorDiv(r->x + (r->w > 0 ? r->w - 1 : 0), GRID_CELL_SIZE);
+	*y1 = floorDiv(r->y + (r->h > 0 ? r->h - 1 : 0), GRID_CELL_SIZE);
+}
+
+static void allocBuckets(struct Grid *grid, uint32_t count) {
+	grid->buckets = malloc(sizeof(int32_t) * count);
+	if (!grid->buckets) {
+		puts("E: Out of memory while growing spatial index");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		grid->buckets[i] = GRID_NIL;
+
+	grid->bucketMask = count - 1;
+}
+
+/* Keep chains short by doubling the bucket table as the grid fills */
+static void rehash(struct Grid *grid) {
+	free(grid->buckets);
+	allocBuckets(grid, (grid->bucketMask + 1) * 2);
+
+	for (int32_t i = 0; i < grid->entryCount; i++) {
+		struct GridEntry *e = &grid->entries[i];
+		if (!e->used)
+			continue;
+
+		uint32_t b = cellHash(e->cx, e->cy) & grid->bucketMask;
+		e->next = grid->buckets[b];
+		grid->buckets[b] = i;
+	}
+}
+
+static void cellLink(struct Grid *grid, int32_t cx, int32_t cy, uint32_t id,
+					 const SDL_Rect *bounds) {
+	int32_t index;
+
+	if (grid->freeList != GRID_NIL) {
+		index = grid->freeList;
+		grid->freeList = grid->entries[index].next;
+	} else {
+		if (grid->entryCount == grid->entryCapacity) {
+			grid->entryCapacity =
+				grid->entryCapacity ? grid->entryCapacity * 2 : 256;
+			grid->entries = realloc(grid->entries, sizeof(struct GridEntry) *
+													   grid->entryCapacity);
+			if (!grid->entries) {
+				puts("E: Out of memory while growing spatial index");
+				exit(1);
+			}
+		}
+
+		index = grid->entryCount++;
+	}
+
+	struct GridEntry *e = &grid->entries[index];
+	e->cx = cx;
+	e->cy = cy;
+	e->id = id;
+	e->bounds = *bounds;
+	e->used = true;
+
+	uint32_t b = cellHash(cx, cy) & grid->bucketMask;
+	e->next = grid->buckets[b];
+	grid->buckets[b] = index;
+
+	grid->liveCount++;
+}
+
+static void cellUnlink(struct Grid *grid, int32_t cx, int32_t cy, uint32_t id) {
+	uint32_t b = cellHash(cx, cy) & grid->bucketMask;
+
+	int32_t *prev = &grid->buckets[b];
+	while (*prev != GRID_NIL) {
+		struct GridEntry *e = &grid->entries[*prev];
+
+		if (e->id == id && e->cx == cx && e->cy == cy) {
+			int32_t index = *prev;
+			*prev = e->next;
+
+			e->used = false;
+			e->next = grid->freeList;
+			grid->freeList = index;
+
+			grid->liveCount--;
+			return;
+		}
+
+		prev = &e->next;
+	}
+}
+
+void gridInit(struct Grid *grid) {
+	grid->entries = NULL;
+	grid->entryCount = 0;
+	grid->entryCapacity = 0;
+	grid->freeList = GRID_NIL;
+	grid->liveCount = 0;
+
+	allocBuckets(grid, 256);
+}
+
+void gridDestroy(struct Grid *grid) {
+	free(grid->buckets);
+	free(grid->entries);
+
+	grid->buckets = NULL;
+	grid->entries = NULL;
+}
+
+void gridInsert(struct Grid *grid, uint32_t id, const SDL_Rect *bounds) {
+	int x0, y0, x1, y1;
+	cellRange(bounds, &x0, &y0, &x1, &y1);
+
+	for (int cy = y0; cy <= y1; cy++) {
+		for (int cx = x0; cx <= x1; cx++)
+			cellLink(grid, cx, cy, id, bounds);
+	}
+
+	if (grid->liveCount > (grid->bucketMask + 1) * 2)
+		rehash(grid);
+}
+
+void gridRemove(struct Grid *grid, uint32_t id, const SDL_Rect *bounds) {
+	int x0, y0, x1, y1;
+	cellRange(bounds, &x0, &y0, &x1, &y1);
+
+	for (int cy = y0; cy <= y1; cy++) {
+		for (int cx = x0; cx <= x1; cx++)
+			cellUnlink(grid, cx, cy, id);
+	}
+}
+
+/* Distance test between a circle and an item's bounds */
+static bool circleOverlaps(const SDL_Rect *b, int x, int y, int radius) {
+	long dx = x - SDL_max(b->x, SDL_min(x, b->x + b->w - 1));
+	long dy = y - SDL_max(b->y, SDL_min(y, b->y + b->h - 1));
+
+	return dx * dx + dy * dy <= (long)radius * radius;
+}
+
+/*
+** Visits every item whose bounds overlap the area, and the circle too if
+** one is given. An item spanning several cells is only reported from the
+** first cell of its overlap with the area, so nothing comes back twice.
+** Returns the number of ids written, at most max.
+*/
+static int query(struct Grid *grid, const SDL_Rect *area, const int *circle,
+				 uint32_t *out, int max) {
+	int found = 0;
+	int x0, y0, x1, y1;
+	cellRange(area, &x0, &y0, &x1, &y1);
+
+	for (int cy = y0; cy <= y1; cy++) {
+		for (int cx = x0; cx <= x1; cx++) {
+			uint32_t b = cellHash(cx, cy) & grid->bucketMask;
+
+			for (int32_t i = grid->buckets[b]; i != GRID_NIL;
+				 i = grid->entries[i].next) {
+				struct GridEntry *e = &grid->entries[i];
+				if (e->cx != cx || e->cy != cy)
+					continue;
+
+				if (!SDL_HasIntersection(&e->bounds, area))
+					continue;
+
+				int ex0, ey0, ex1, ey1;
+				cellRange(&e->bounds, &ex0, &ey0, &ex1, &ey1);
+				if (cx != SDL_max(ex0, x0) || cy != SDL_max(ey0, y0))
+					continue;
+
+				if (circle && !circleOverlaps(&e->bounds, circle[0],
+											  circle[1], circle[2]))
+					continue;
+
+				if (found == max)
+					return found;
+				out[found++] = e->id;
+			}
+		}
+	}
+
+	return found;
+}
+
+int gridQueryRect(struct Grid *grid, const SDL_Rect *area, uint32_t *out,
+				  int max) {
+	return query(grid, area, NULL, out, max);
+}
+
+int gridQueryPoint(struct Grid *grid, int x, int y, uint32_t *out, int max) {
+	SDL_Rect area = {x, y, 1, 1};
+	return query(grid, &area, NULL, out, max);
+}
+
+int gridQueryRadius(struct Grid *grid, int x, int y, int radius, uint32_t *out,
+					int max) {
+	SDL_Rect area = {x - radius, y - radius, radius * 2 + 1, radius * 2 + 1};
+	int circle[3] = {x, y, radius};
+
+	return query(grid, &area, circle, out, max);
+}
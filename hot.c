@@ -0,0 +1,200 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Development hot reload routines
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tank.h"
+
+extern int currentLevel;
+
+/*
+** In dev mode (-w), levels/ and everything under res/ are watched with
+** inotify. hotPoll is called between ticks and picks up whatever was
+** written since last time. Changed textures are re-uploaded in place
+** through the asset cache right there. A change to the current level's
+** text file is only reported, since the caller owns the level and player.
+**
+** Only files that are finished being written (or renamed into place, as
+** most editors do) count, so a half-saved image is never loaded.
+*/
+#ifdef __linux__
+
+#define HOT_MAX_WATCHES 64
+#define HOT_MAX_PENDING 32
+
+struct Watch {
+	int wd;
+	char dir[LVL_MAX_PATH];
+};
+
+static int inotifyFd = -1;
+static struct Watch watches[HOT_MAX_WATCHES];
+static int watchCount = 0;
+
+static void hotWatch(const char *dir) {
+	if (watchCount == HOT_MAX_WATCHES) {
+		printf("W: Too many directories to watch; ignoring \"%s\"\n", dir);
+		return;
+	}
+
+	char path[LVL_MAX_PATH];
+	if (!packLoosePath(dir, path, sizeof(path)))
+		return;
+
+	int wd = inotify_add_watch(inotifyFd, path, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0) {
+		printf("W: Could not watch \"%s\": %s\n", path, strerror(errno));
+		return;
+	}
+
+	watches[watchCount].wd = wd;
+	snprintf(watches[watchCount].dir, LVL_MAX_PATH, "%s", dir);
+	watchCount++;
+
+	/* inotify isn't recursive, so every subdirectory needs its own watch */
+	DIR *d = opendir(path);
+	if (!d)
+		return;
+
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		if (ent->d_name[0] == '.')
+			continue;
+
+		char child[LVL_MAX_PATH], childPath[LVL_MAX_PATH];
+		struct stat st;
+		snprintf(child, sizeof(child), "%s/%s", dir, ent->d_name);
+		snprintf(childPath, sizeof(childPath), "%s/%s", path, ent->d_name);
+
+		if (stat(childPath, &st) == 0 && S_ISDIR(st.st_mode))
+			hotWatch(child);
+	}
+
+	closedir(d);
+}
+
+bool hotInit() {
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0) {
+		printf("W: Could not start watching files: %s\n", strerror(errno));
+		return false;
+	}
+
+	hotWatch("levels");
+	hotWatch("res");
+
+	printf("DEBUG: Watching %i directories for changes\n", watchCount);
+	return true;
+}
+
+void hotDestroy() {
+	if (inotifyFd >= 0)
+		close(inotifyFd);
+
+	inotifyFd = -1;
+	watchCount = 0;
+}
+
+static const char *watchDir(int wd) {
+	for (int i = 0; i < watchCount; i++) {
+		if (watches[i].wd == wd)
+			return watches[i].dir;
+	}
+
+	return NULL;
+}
+
+static bool hasSuffix(const char *name, const char *suffix) {
+	size_t n = strlen(name), s = strlen(suffix);
+	return n >= s && strcmp(name + n - s, suffix) == 0;
+}
+
+int hotPoll() {
+	if (inotifyFd < 0)
+		return HOT_NONE;
+
+	union {
+		struct inotify_event event;
+		char bytes[4096];
+	} buf;
+
+	/* One save can show up as several events; reload each file once */
+	char pending[HOT_MAX_PENDING][LVL_MAX_PATH];
+	int pendingCount = 0;
+	int changed = HOT_NONE;
+
+	char levelName[64];
+	snprintf(levelName, sizeof(levelName), "level%i.txt", currentLevel);
+
+	ssize_t len;
+	while ((len = read(inotifyFd, buf.bytes, sizeof(buf.bytes))) > 0) {
+		for (char *p = buf.bytes; p < buf.bytes + len;) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			const char *dir = watchDir(ev->wd);
+			if (!dir || !ev->len)
+				continue;
+
+			if (strcmp(dir, "levels") == 0 &&
+				strcmp(ev->name, levelName) == 0) {
+				changed |= HOT_LEVEL;
+				continue;
+			}
+
+			if (!hasSuffix(ev->name, ".png"))
+				continue;
+
+			char path[LVL_MAX_PATH];
+			snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+
+			bool seen = false;
+			for (int i = 0; i < pendingCount && !seen; i++)
+				seen = strcmp(pending[i], path) == 0;
+
+			if (!seen && pendingCount < HOT_MAX_PENDING)
+				strcpy(pending[pendingCount++], path);
+		}
+	}
+
+	for (int i = 0; i < pendingCount; i++) {
+		if (assetReload(pending[i]))
+			changed |= HOT_TEXTURE;
+	}
+
+	return changed;
+}
+
+#else
+
+bool hotInit() {
+	puts("W: Hot reload needs inotify, which is only available on Linux");
+	return false;
+}
+
+void hotDestroy() {}
+
+int hotPoll() {
+	return HOT_NONE;
+}
+
+#endif
@@ -6,10 +6,139 @@
  * Main HUD (Heads Up Display) code
  */
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
 #include "../tank.h"
 #include "hud.h"
 
-void HUDRender(struct Level *lvl)
-{
-	return;
+extern struct SDL_Renderer *renderer;
+
+/* Profiler overlay */
+static const float frameBudget = 1000.0f / 60.0f;
+static const uint32_t statsInterval = 500;
+static const int graphHeight = 64;
+
+static bool showProfiler = false;
+static struct ProfileStats stats[PROF_PHASE_COUNT];
+static char statsTable[PROF_PHASE_COUNT * 64 + 64];
+static int statsW, statsH;
+static uint32_t statsUpdated = 0;
+
+static const SDL_Color hudColor = {255, 255, 255, 255};
+
+void HUDToggleProfiler() {
+	showProfiler = !showProfiler;
+	statsUpdated = 0;
+}
+
+/* The overlay changes constantly, so while it's up every frame is drawn */
+bool HUDProfilerShown() {
+	return showProfiler;
+}
+
+/*
+** Drawing the table is cheap now it comes from the glyph atlas, but the
+** numbers are still only refreshed twice a second so they can be read.
+*/
+static void updateStatsText() {
+	int len = snprintf(statsTable, sizeof(statsTable), "%-13s%7s%7s%7s\n",
+					   "ms", "min", "avg", "p99");
+
+	for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+		profileStats(i, &stats[i]);
+		len += snprintf(statsTable + len, sizeof(statsTable) - len,
+						"%-13s%7.2f%7.2f%7.2f\n", profileName(i), stats[i].min,
+						stats[i].avg, stats[i].p99);
+	}
+
+	textMeasure(TEXT_SMALL, statsTable, &statsW, &statsH);
+}
+
+static void profilerRender() {
+	uint32_t now = SDL_GetTicks();
+	if (!statsUpdated || now - statsUpdated >= statsInterval) {
+		updateStatsText();
+		statsUpdated = now;
+	}
+
+	int line = textLineHeight(TEXT_SMALL);
+	int barX = 16 + statsW + 8;
+	int barW = 120;
+
+	SDL_Rect panel = {8, 8, barX + barW, statsH + graphHeight + 24};
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
+	SDL_RenderFillRect(renderer, &panel);
+
+	textDraw(TEXT_SMALL, statsTable, 16, 12, hudColor);
+	batchFlush();
+
+	/* Average as a bar, p99 as a tick, both against one 60Hz frame */
+	for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+		int y = 12 + line * (i + 1) + 2;
+		int avg = (int)(stats[i].avg / frameBudget * barW);
+		int p99 = (int)(stats[i].p99 / frameBudget * barW);
+
+		SDL_Rect bar = {barX, y, SDL_min(avg, barW), line - 4};
+		SDL_SetRenderDrawColor(renderer, 80, 200, 80, 255);
+		SDL_RenderFillRect(renderer, &bar);
+
+		SDL_SetRenderDrawColor(renderer, 230, 60, 40, 255);
+		int px = barX + SDL_min(p99, barW);
+		SDL_RenderDrawLine(renderer, px, y, px, y + line - 4);
+	}
+
+	/* Frame time graph, newest on the right, scaled to two frames */
+	float history[PROF_HISTORY];
+	int count = profileHistory(PROF_FRAME, history, PROF_HISTORY);
+	int graphY = 12 + statsH + 8;
+	int graphX = panel.x + panel.w - 8 - PROF_HISTORY;
+	float scale = graphHeight / (frameBudget * 2);
+
+	for (int i = 0; i < count; i++) {
+		int x = graphX + (PROF_HISTORY - count) + i;
+		int hgt = SDL_min((int)(history[i] * scale), graphHeight);
+
+		if (history[i] > frameBudget)
+			SDL_SetRenderDrawColor(renderer, 230, 60, 40, 255);
+		else
+			SDL_SetRenderDrawColor(renderer, 80, 200, 80, 255);
+
+		SDL_RenderDrawLine(renderer, x, graphY + graphHeight, x,
+						   graphY + graphHeight - hgt);
+	}
+
+	int budgetY = graphY + graphHeight - (int)(frameBudget * scale);
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	SDL_RenderDrawLine(renderer, graphX, budgetY, graphX + PROF_HISTORY,
+					   budgetY);
+
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+
+/* Counters that change every frame, drawn fresh every frame */
+static void countersRender(struct WorldSnapshot *world) {
+	char text[64];
+	snprintf(text, sizeof(text), "nodes %i/%i", world->nodesUsed,
+			 world->maxNodes);
+
+	/* Drawn in logical coordinates, whatever the window really is */
+	int w, h, screenW, screenH;
+	textMeasure(TEXT_MEDIUM, text, &w, &h);
+	scaleLogicalSize(&screenW, &screenH);
+
+	textDraw(TEXT_MEDIUM, text, screenW - w - 12, 8, hudColor);
+	batchFlush();
+}
+
+void HUDRender(struct WorldSnapshot *world) {
+	if (world)
+		countersRender(world);
+
+	if (showProfiler)
+		profilerRender();
 }
@@ -9,6 +9,12 @@
 #ifndef HUD_H_INCLUDED
 #define HUD_H_INCLUDED
 
-void HUDRender();
+#include <stdbool.h>
+
+struct WorldSnapshot;
+
+void HUDRender(struct WorldSnapshot *world);
+void HUDToggleProfiler();
+bool HUDProfilerShown();
 
 #endif
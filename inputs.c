@@ -9,63 +9,225 @@
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
-static bool *keys = NULL;
-static int keysRegistered = 0;
-
-static bool mice[] = {false, false, false, false, false};
-
-void updateKeys(char key, bool down) {
-	uint8_t keyi = (int8_t)key;
-
-	if (keys == NULL) {
-		keys = malloc(sizeof(bool) * keyi);
-
-		keysRegistered = keyi;
-		memset(keys, 0x0, keysRegistered);
-
-		keys[keyi] = down;
-	} else if (keyi > keysRegistered) {
-		keys = realloc(keys, sizeof(bool) * keyi);
-		keysRegistered = keyi;
-
-		/* ALERT: Hacky code warning!
-		 *
-		 * TODO: Find out a better way to do this (that doesn't crash the
-		 * program)
-		 *
-		 * We are zeroing the entire keymap dictionary here!
-		 * This will release all keys that the user is currently pressing,
-		 * causing a possible visual delay/desync.
-		 *
-		 * The way I was doing this was to zero out the newly allocated keys,
-		 * but it appears that was causing segfaults and random aborts from
-		 * GLib.
-		 *
-		 * For now, I am going to stick to just re-initialising the whole
-		 * dictionary.
-		 * */
-		memset(keys, 0x0, keysRegistered);
-
-		keys[keyi] = down;
+#include "tank.h"
+
+/*
+** Input arrives from handleEvents (or a replay) whenever it likes, but the
+** simulation should see it change only between ticks. So the handlers
+** update a live copy of the state and queue the event, and inputBeginTick
+** snapshots both for the tick about to run. Everything a tick reads comes
+** from that snapshot, which holds still for the whole tick.
+**
+** Keys are indexed by scancode in a fixed bitset. Alongside which keys are
+** held, the snapshot keeps which went down and which came up since the
+** last tick, so a tap shorter than a tick is still seen.
+**
+** Ticks may run on the simulation thread (see sim.c) while events arrive
+** on the main thread, so the live copy and queue are guarded by a spin
+** lock. It is only ever held for a few stores or one copy.
+**
+** Recording happens as each tick takes its input, so every event is
+** stamped with the tick that first saw it, whichever thread that ran on.
+** Replays depend on every key and button transition reaching the queue,
+** so only the pointer's position is ever given up to make room: runs of
+** motion keep just their last position, and a full queue drops motion
+** that a later position has already replaced.
+*/
+#define KEY_WORDS (SDL_NUM_SCANCODES / 32)
+
+struct InputState {
+	uint32_t held[KEY_WORDS];
+	uint32_t pressed[KEY_WORDS];
+	uint32_t released[KEY_WORDS];
+
+	uint8_t miceHeld;
+	uint8_t micePressed;
+	uint8_t miceReleased;
+
+	int mouseX, mouseY;
+};
+
+static struct InputState live;
+static struct InputState tickState;
+
+static struct InputEvent queue[INPUT_QUEUE_SIZE];
+static int queued = 0;
+
+static int lost = 0;
+
+static struct InputEvent tickEvents[INPUT_QUEUE_SIZE];
+static int tickEventCount = 0;
+
+static SDL_SpinLock inputLock = 0;
+
+/* Drops the oldest motion some later event carries a newer position past */
+static bool queueMakeRoom(uint8_t type) {
+	int newest = type == INPUT_KEY ? -1 : queued;
+	for (int i = queued - 1; newest < 0 && i >= 0; i--)
+		if (queue[i].type != INPUT_KEY)
+			newest = i;
+
+	for (int i = 0; i < newest; i++) {
+		if (queue[i].type == INPUT_MOUSEMOVE) {
+			memmove(&queue[i], &queue[i + 1],
+					sizeof(struct InputEvent) * (queued - i - 1));
+			queued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void queueEvent(uint8_t type, uint16_t code, bool down, int x, int y) {
+	struct InputEvent *ev;
+
+	if (type == INPUT_MOUSEMOVE && queued &&
+		queue[queued - 1].type == INPUT_MOUSEMOVE) {
+		ev = &queue[queued - 1];
+	} else if (queued < INPUT_QUEUE_SIZE || queueMakeRoom(type)) {
+		ev = &queue[queued++];
 	} else {
-		keys[keyi] = down;
+		/* State still changes; only the event and its record are lost */
+		lost++;
+		return;
 	}
+
+	ev->time = SDL_GetTicks();
+	ev->type = type;
+	ev->down = down;
+	ev->code = code;
+	ev->x = x;
+	ev->y = y;
 }
 
-void updateMice(uint8_t button, bool pressed) {
-	mice[button] = pressed;
+void updateKeys(uint16_t scancode, bool down) {
+	if (scancode >= SDL_NUM_SCANCODES)
+		return;
+
+	SDL_AtomicLock(&inputLock);
+	queueEvent(INPUT_KEY, scancode, down, live.mouseX, live.mouseY);
+
+	uint32_t *word = &live.held[scancode >> 5];
+	uint32_t bit = 1u << (scancode & 31);
+
+	if (down && !(*word & bit))
+		live.pressed[scancode >> 5] |= bit;
+	else if (!down && (*word & bit))
+		live.released[scancode >> 5] |= bit;
+
+	*word = down ? *word | bit : *word & ~bit;
+	SDL_AtomicUnlock(&inputLock);
 }
 
-bool isKeyDown(char key) {
-	int8_t keyi = (int8_t)key;
-	if (keyi > keysRegistered) {
-		return false;
-	} else {
-		return keys[keyi];
+void updateMice(uint8_t button, bool pressed, int x, int y) {
+	if (button >= 8)
+		return;
+
+	uint8_t bit = 1u << button;
+
+	SDL_AtomicLock(&inputLock);
+	queueEvent(INPUT_MOUSEBUTTON, button, pressed, x, y);
+
+	if (pressed && !(live.miceHeld & bit))
+		live.micePressed |= bit;
+	else if (!pressed && (live.miceHeld & bit))
+		live.miceReleased |= bit;
+
+	live.miceHeld = pressed ? live.miceHeld | bit : live.miceHeld & ~bit;
+	live.mouseX = x;
+	live.mouseY = y;
+	SDL_AtomicUnlock(&inputLock);
+}
+
+void updateMouse(int x, int y) {
+	SDL_AtomicLock(&inputLock);
+	queueEvent(INPUT_MOUSEMOVE, 0, false, x, y);
+
+	live.mouseX = x;
+	live.mouseY = y;
+	SDL_AtomicUnlock(&inputLock);
+}
+
+/* Takes everything that arrived since the last tick as this tick's input */
+void inputBeginTick() {
+	SDL_AtomicLock(&inputLock);
+	tickState = live;
+
+	memset(live.pressed, 0, sizeof(live.pressed));
+	memset(live.released, 0, sizeof(live.released));
+	live.micePressed = 0;
+	live.miceReleased = 0;
+
+	memcpy(tickEvents, queue, sizeof(struct InputEvent) * queued);
+	tickEventCount = queued;
+	queued = 0;
+
+	int dropped = lost;
+	lost = 0;
+	SDL_AtomicUnlock(&inputLock);
+
+	if (dropped)
+		printf("W: Input queue full; %i events lost\n", dropped);
+
+	/* The event types line up with the replay record types */
+	for (int i = 0; i < tickEventCount; i++) {
+		struct InputEvent *ev = &tickEvents[i];
+		replayCapture(ev->type, ev->code, ev->down, ev->x, ev->y);
 	}
 }
 
+/* Every input event that arrived in time for this tick, oldest first */
+const struct InputEvent *inputEvents(int *count) {
+	*count = tickEventCount;
+	return tickEvents;
+}
+
+static inline bool keyBit(const uint32_t *set, SDL_Scancode key) {
+	key &= SDL_NUM_SCANCODES - 1;
+	return (set[key >> 5] >> (key & 31)) & 1;
+}
+
+bool isKeyDown(SDL_Scancode key) {
+	return keyBit(tickState.held, key);
+}
+
+bool isKeyPressed(SDL_Scancode key) {
+	return keyBit(tickState.pressed, key);
+}
+
+bool isKeyReleased(SDL_Scancode key) {
+	return keyBit(tickState.released, key);
+}
+
 bool isMousePressed(uint8_t button) {
-	return mice[button];
+	return (tickState.miceHeld >> (button & 7)) & 1;
+}
+
+bool isMouseClicked(uint8_t button) {
+	return (tickState.micePressed >> (button & 7)) & 1;
+}
+
+bool isMouseReleased(uint8_t button) {
+	return (tickState.miceReleased >> (button & 7)) & 1;
+}
+
+/*
+** The pointer isn't part of the simulation's input snapshot; rendering
+** follows it between ticks, and recording starts from wherever it is.
+*/
+void getMousePosition(int *x, int *y) {
+	SDL_AtomicLock(&inputLock);
+	*x = live.mouseX;
+	*y = live.mouseY;
+	SDL_AtomicUnlock(&inputLock);
+}
+
+/* Where the mouse was as of the start of this tick */
+void getTickMousePosition(int *x, int *y) {
+	*x = tickState.mouseX;
+	*y = tickState.mouseY;
 }
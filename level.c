@@ -19,7 +19,8 @@
 #include "tank.h"
 
 extern struct SDL_Renderer *renderer;
-static bool levelFileParse(FILE *fp, struct Level *level);
+static bool levelPopulate(struct Level *level, struct LevelFile *file,
+						  struct LevelLoad *load);
 
 static char *ent_textures[] = {
 	"res/ent/wall.png",
@@ -27,190 +28,862 @@ static char *ent_textures[] = {
 static int ent_sizes[][2] = {
 	{64, 64},
 };
+static bool ent_static[] = {
+	true,
+};
+static struct Asset **ent_loadedTextures;
+
+/* Shared by every level, so no two ever hand out the same version */
+static uint32_t staticVersions = 0;
 
-static bool nodeDebounce = false;
 static int node_textureCount = 1;
 static char *node_textures[] = {"res/lvl/move.png"};
-static struct SDL_Texture **node_loadedTextures;
+static struct Asset **node_loadedTextures;
 
 static char *placeholderNode_path = "res/lvl/prompt.png";
-static struct SDL_Texture *placeholderNode;
+static struct Asset *placeholderNode;
 
-void levelInit(struct Level *level, struct Player *player, uint32_t levelID) {
+static void levelReset(struct Level *level, uint32_t levelID) {
 	level->levelIndex = levelID;
+	level->levelFile = NULL;
 
 	level->entityCount = 0;
+	level->entityCapacity = 0;
+	level->ents = NULL;
+
+	level->slotCount = 0;
+	level->slotCapacity = 0;
+	level->slots = NULL;
+	level->freeSlot = ENTITY_SLOT_NIL;
+
+	level->maxNodes = 0;
 	level->nodesUsed = 0;
+	level->nodes = NULL;
+
+	level->staticVersion = ++staticVersions;
+
+	level->width = 0;
+	level->height = 0;
+	level->camera = (SDL_Rect){0, 0, 0, 0};
 
-	node_loadedTextures = malloc(sizeof(SDL_Texture *) * node_textureCount);
-	for (int i = 0; i < node_textureCount; i++) {
-		SDL_Surface *surf = loadTexture(node_textures[i]);
-		node_loadedTextures[i] = SDL_CreateTextureFromSurface(renderer, surf);
+	level->viewVersion = 0;
+	level->viewStaticCount = 0;
+	level->viewStatics = NULL;
+	level->viewHits = NULL;
 
-		SDL_FreeSurface(surf);
+	memset(level->chunks, 0, sizeof(level->chunks));
+	level->chunkClock = 0;
+	level->bakedView = (SDL_Rect){0, 0, 0, 0};
+	level->staticDirty = true;
+
+	gridInit(&level->grid);
+	gridInit(&level->viewGrid);
+}
+
+/*
+** Loading is split in two. levelLoadRun does everything that doesn't
+** touch the renderer: reading the level file, building entity storage and
+** the grid, and decoding every image the level draws with. It may run on
+** a thread of its own, and publishes how far it has got as it goes.
+** levelLoadFinish then does the rest on the render thread, which is just
+** uploading those images and handing the textures out.
+**
+** Decoded images are kept in a fixed order: one per entity type, then the
+** node textures, then the placeholder node.
+*/
+static void levelLoadRun(struct LevelLoad *load) {
+	traceBegin("levelLoad");
+	struct Level *level = load->level;
+
+	struct LevelFile file;
+	if (!levelFileOpen(&file, load->levelID)) {
+		load->failed = true;
+		goto done;
 	}
 
-	SDL_Surface *placeholderSurf = loadTexture(placeholderNode_path);
-	placeholderNode = SDL_CreateTextureFromSurface(renderer, placeholderSurf);
+	SDL_AtomicSet(&load->total,
+				  (int)file.header.entityCount + load->surfaceCount);
 
-	char filename[50];
-	snprintf(filename, 50, "levels/level%i.txt", levelID);
-	level->levelFile = filename;
+	if (!levelPopulate(level, &file, load)) {
+		levelFileClose(&file);
+		load->failed = true;
+		goto done;
+	}
+
+	level->levelFile = malloc(strlen(file.path) + 1);
+	strcpy(level->levelFile, file.path);
+	levelFileClose(&file);
 
-	FILE *lef = fopen(filename, "r");
+	for (int i = 0; i < load->surfaceCount; i++) {
+		if (SDL_AtomicGet(&load->cancelled))
+			break;
 
-	bool valid = levelFileParse(lef, level);
-	if (!valid) {
-		puts("E: Invalid level file detected");
+		/* Exiting here would pull the game out from under the main thread */
+		if (!load->cached[i]) {
+			load->surfaces[i] = decodeTexture(load->surfacePaths[i]);
+			if (!load->surfaces[i]) {
+				load->missing = load->surfacePaths[i];
+				load->failed = true;
+				break;
+			}
+		}
+		SDL_AtomicAdd(&load->done, 1);
+	}
+
+done:
+	traceEnd("levelLoad");
+	SDL_AtomicSet(&load->finished, 1);
+}
+
+static int levelLoadWorker(void *data) {
+	traceThreadName("level loader");
+	levelLoadRun(data);
+
+	return 0;
+}
+
+/* Starts loading, on a worker thread if asked and one can be had */
+void levelLoadStart(struct LevelLoad *load, struct Level *level,
+					uint32_t levelID, bool threaded) {
+	int typeCount = sizeof(ent_textures) / sizeof(ent_textures[0]);
+
+	levelReset(level, levelID);
+
+	load->level = level;
+	load->levelID = levelID;
+	load->thread = NULL;
+	load->failed = false;
+	load->missing = NULL;
+	SDL_AtomicSet(&load->done, 0);
+	SDL_AtomicSet(&load->total, 0);
+	SDL_AtomicSet(&load->finished, 0);
+	SDL_AtomicSet(&load->cancelled, 0);
+
+	load->surfaceCount = 0;
+	for (int i = 0; i < typeCount; i++)
+		load->surfacePaths[load->surfaceCount++] = ent_textures[i];
+	for (int i = 0; i < node_textureCount; i++)
+		load->surfacePaths[load->surfaceCount++] = node_textures[i];
+	load->surfacePaths[load->surfaceCount++] = placeholderNode_path;
+
+	/* No point decoding what's already in the cache (the worker can't ask) */
+	for (int i = 0; i < load->surfaceCount; i++) {
+		load->surfaces[i] = NULL;
+		load->cached[i] = assetCached(load->surfacePaths[i]);
+	}
+
+	if (threaded)
+		load->thread = SDL_CreateThread(levelLoadWorker, "levelLoad", load);
+
+	if (!load->thread)
+		levelLoadRun(load);
+}
+
+bool levelLoadDone(struct LevelLoad *load) {
+	return SDL_AtomicGet(&load->finished);
+}
+
+float levelLoadProgress(struct LevelLoad *load) {
+	int total = SDL_AtomicGet(&load->total);
+	if (!total)
+		return 0.0f;
+
+	return (float)SDL_AtomicGet(&load->done) / total;
+}
+
+/* Everything but textures; shared by levelDestroy and a cancelled load */
+static void levelFree(struct Level *level) {
+	free(level->ents);
+	free(level->slots);
+
+	gridDestroy(&level->grid);
+	free(level->nodes);
+	free(level->levelFile);
+
+	gridDestroy(&level->viewGrid);
+	free(level->viewStatics);
+	free(level->viewHits);
+
+	level->ents = NULL;
+	level->slots = NULL;
+	level->nodes = NULL;
+	level->levelFile = NULL;
+	level->viewStatics = NULL;
+	level->viewHits = NULL;
+	level->entityCount = 0;
+	level->viewStaticCount = 0;
+}
+
+static void levelLoadJoin(struct LevelLoad *load) {
+	if (load->thread)
+		SDL_WaitThread(load->thread, NULL);
+
+	load->thread = NULL;
+}
+
+/* Must be called from the render thread; blocks if loading isn't done */
+void levelLoadFinish(struct LevelLoad *load, struct Player *player) {
+	struct Level *level = load->level;
+	int typeCount = sizeof(ent_textures) / sizeof(ent_textures[0]);
+
+	levelLoadJoin(load);
+
+	if (load->failed) {
+		if (load->missing)
+			printf("E: Missing texture detected: \"%s\"\n", load->missing);
+		else
+			puts("E: Invalid level file detected");
 		exit(-1);
 	}
 
-	fclose(lef);
+	traceBegin("levelLoadFinish");
+
+	struct Asset *loaded[LEVEL_LOAD_MAX_TEXTURES];
+	for (int i = 0; i < load->surfaceCount; i++) {
+		if (load->surfaces[i])
+			loaded[i] = assetAcquireSurface(load->surfacePaths[i],
+											load->surfaces[i]);
+		else
+			loaded[i] = assetAcquire(load->surfacePaths[i]);
+
+		load->surfaces[i] = NULL;
+	}
+
+	/*
+	** The level holds one reference per entity type, which its entities
+	** borrow. That way adding and removing them never touches the asset
+	** cache, which belongs to the main thread.
+	*/
+	ent_loadedTextures = malloc(sizeof(struct Asset *) * typeCount);
+	for (int i = 0; i < typeCount; i++)
+		ent_loadedTextures[i] = loaded[i];
+
+	for (uint32_t i = 0; i < level->entityCount; i++) {
+		struct Entity *ent = &level->ents[i];
+		ent->texture = loaded[ent->type];
+	}
+
+	node_loadedTextures = malloc(sizeof(struct Asset *) * node_textureCount);
+	for (int i = 0; i < node_textureCount; i++)
+		node_loadedTextures[i] = loaded[typeCount + i];
+
+	placeholderNode = loaded[typeCount + node_textureCount];
+
+	player->x = player->prevX = level->startPoint[0];
+	player->y = player->prevY = level->startPoint[1];
+
+	float x, y;
+	tankFocus(player, 1.0, &x, &y);
+	cameraFollow(&level->camera, level->width, level->height, x, y);
+
+	traceEnd("levelLoadFinish");
+}
+
+/* Abandons a load part way, freeing whatever it had built so far */
+void levelLoadCancel(struct LevelLoad *load) {
+	SDL_AtomicSet(&load->cancelled, 1);
+	levelLoadJoin(load);
+
+	for (int i = 0; i < load->surfaceCount; i++) {
+		if (load->surfaces[i])
+			SDL_FreeSurface(load->surfaces[i]);
+		load->surfaces[i] = NULL;
+	}
+
+	levelFree(load->level);
+}
+
+void levelInit(struct Level *level, struct Player *player, uint32_t levelID) {
+	traceBegin("levelInit");
+
+	struct LevelLoad load;
+	levelLoadStart(&load, level, levelID, false);
+	levelLoadFinish(&load, player);
 
-	player->x = level->startPoint[0];
-	player->y = level->startPoint[1];
+	traceEnd("levelInit");
 }
 
 void levelDestroy(struct Level *level) {
-	for (int i = 0; i < level->entityCount; i++) {
-		free(level->ents[i]);
+	int typeCount = sizeof(ent_textures) / sizeof(ent_textures[0]);
+
+	for (int i = 0; i < typeCount; i++) {
+		assetRelease(ent_loadedTextures[i]);
 	}
 
+	free(ent_loadedTextures);
+
 	for (int j = 0; j < node_textureCount; j++) {
-		SDL_DestroyTexture(node_loadedTextures[j]);
+		assetRelease(node_loadedTextures[j]);
 	}
 
 	free(node_loadedTextures);
-	free(level->nodes);
+	assetRelease(placeholderNode);
+
+	for (int i = 0; i < LEVEL_MAX_CHUNKS; i++) {
+		if (level->chunks[i].texture)
+			SDL_DestroyTexture(level->chunks[i].texture);
+	}
+
+	levelFree(level);
 }
 
-int addEntity(struct Level *level, enum EntityType type, uint8_t initialHealth,
-			  bool canDamage, int x, int y, uint8_t orientation) {
-	level->entityCount++;
-	if (level->entityCount > LVL_MAX_ENTITY_COUNT) {
-		return -1;
+/*
+** Entities live in one dense array, so walking every live entity is a
+** straight run through memory. Outside code refers to them by EntityID,
+** which names a slot plus that slot's generation. Slots point at the
+** entity's current place in the dense array and are recycled through a
+** free list; bumping the generation on removal means stale IDs for a
+** recycled slot are caught rather than silently aimed at a new entity.
+**
+** Removal moves the last entity into the hole, so it is O(1) but does
+** reorder the dense array. Pointers from levelEntity() are only good
+** until the next add or remove.
+*/
+static void growEntities(struct Level *level) {
+	if (level->entityCount < level->entityCapacity)
+		return;
+
+	level->entityCapacity =
+		level->entityCapacity ? level->entityCapacity * 2 : 64;
+	level->ents =
+		realloc(level->ents, sizeof(struct Entity) * level->entityCapacity);
+	if (!level->ents) {
+		puts("E: Out of memory while growing entity storage");
+		exit(1);
 	}
+}
+
+static uint32_t allocSlot(struct Level *level) {
+	if (level->freeSlot != ENTITY_SLOT_NIL) {
+		uint32_t slot = level->freeSlot;
+		level->freeSlot = level->slots[slot].index;
+
+		return slot;
+	}
+
+	if (level->slotCount == level->slotCapacity) {
+		level->slotCapacity = level->slotCapacity ? level->slotCapacity * 2 : 64;
+		level->slots = realloc(level->slots, sizeof(struct EntitySlot) *
+												 level->slotCapacity);
+		if (!level->slots) {
+			puts("E: Out of memory while growing entity storage");
+			exit(1);
+		}
+	}
+
+	level->slots[level->slotCount].generation = 1;
+	return level->slotCount++;
+}
+
+static EntityID insertEntity(struct Level *level, enum EntityType type,
+							 uint8_t initialHealth, bool canDamage, int x,
+							 int y, uint8_t orientation,
+							 struct Asset *texture) {
+	traceBegin("addEntity");
+	growEntities(level);
+
+	uint32_t slot = allocSlot(level);
+	uint32_t index = level->entityCount++;
 
-	struct Entity *ent = malloc(sizeof(struct Entity));
+	struct Entity *ent = &level->ents[index];
 	ent->type = type;
 	ent->health = initialHealth;
 	ent->canDamage = canDamage;
 	ent->x = x;
 	ent->y = y;
 	ent->orientation = orientation;
+	ent->slot = slot;
+	ent->texture = texture;
 
-	ent->texSurface = loadTexture(ent_textures[type]);
-	ent->texture = SDL_CreateTextureFromSurface(renderer, ent->texSurface);
+	level->slots[slot].live = true;
+	level->slots[slot].index = index;
 
-	level->ents[level->entityCount - 1] = ent;
+	SDL_Rect bounds;
+	entityBounds(ent, &bounds);
+	gridInsert(&level->grid, slot, &bounds);
 
-	return level->entityCount - 1;
+	level->width = SDL_max(level->width, bounds.x + bounds.w);
+	level->height = SDL_max(level->height, bounds.y + bounds.h);
+
+	traceEnd("addEntity");
+	return ((EntityID)level->slots[slot].generation << 32) | slot;
 }
 
-void removeEntity(struct Level *level, unsigned int id) {
-	level->ents[id]->isRemoved = true;
-	level->entityCount--;
+EntityID addEntity(struct Level *level, enum EntityType type,
+				   uint8_t initialHealth, bool canDamage, int x, int y,
+				   uint8_t orientation) {
+	return insertEntity(level, type, initialHealth, canDamage, x, y,
+						orientation, ent_loadedTextures[type]);
 }
 
-void levelRender(struct Level *level) {
-	int x, y;
-	struct SDL_Rect mouserect;
-	SDL_GetMouseState(&x, &y);
-	mouserect.w = 32;
-	mouserect.h = 32;
-	mouserect.x = x; /* - (mouserect.w / 2); */
-	mouserect.y = y; /* - (mouserect.h / 2); */
+struct Entity *levelEntity(struct Level *level, EntityID id) {
+	uint32_t slot = (uint32_t)id;
+	uint32_t generation = (uint32_t)(id >> 32);
 
-	if (isMousePressed(1)) {
-		if (!nodeDebounce) {
-			if (level->nodesUsed < level->maxNodes) {
-				nodeDebounce = true;
+	if (slot >= level->slotCount || !level->slots[slot].live ||
+		level->slots[slot].generation != generation)
+		return NULL;
 
-				level->nodes[level->nodesUsed].type = move;
-				level->nodes[level->nodesUsed].x = x;
-				level->nodes[level->nodesUsed].y = y;
-				level->nodes[level->nodesUsed].orientation = 0;
+	return &level->ents[level->slots[slot].index];
+}
 
-				level->nodesUsed++;
-			}
-		}
+void removeEntity(struct Level *level, EntityID id) {
+	struct Entity *ent = levelEntity(level, id);
+	if (!ent)
+		return;
+
+	SDL_Rect bounds;
+	entityBounds(ent, &bounds);
+	gridRemove(&level->grid, ent->slot, &bounds);
+
+	if (ent_static[ent->type])
+		level->staticVersion = ++staticVersions;
+
+	/* Fill the hole with the last entity and repoint its slot */
+	uint32_t slot = ent->slot;
+	uint32_t index = level->slots[slot].index;
+	uint32_t last = --level->entityCount;
+
+	if (index != last) {
+		level->ents[index] = level->ents[last];
+		level->slots[level->ents[index].slot].index = index;
 	}
 
-	if (!isMousePressed(1)) {
-		nodeDebounce = false;
+	level->slots[slot].live = false;
+	level->slots[slot].generation++;
+	level->slots[slot].index = level->freeSlot;
+	level->freeSlot = slot;
+}
+
+void damageEntity(struct Level *level, EntityID id, uint8_t amount) {
+	struct Entity *ent = levelEntity(level, id);
+	if (!ent || !ent->canDamage)
+		return;
+
+	if (amount >= ent->health) {
+		removeEntity(level, id);
+		return;
 	}
 
-	for (int i = 0; i < level->entityCount; i++) {
-		struct Entity ent = *level->ents[i];
+	ent->health -= amount;
+	if (ent_static[ent->type])
+		level->staticVersion = ++staticVersions;
+}
 
-		struct SDL_Rect place = {
-			ent.x,
-			ent.y,
-			ent_sizes[ent.type][0],
-			ent_sizes[ent.type][1],
-		};
+void levelInvalidateStatic(struct Level *level) {
+	level->staticDirty = true;
+}
 
-		SDL_RenderCopyEx(renderer, ent.texture, NULL, &place,
-						 (ent.orientation * 90.0), NULL, SDL_FLIP_NONE);
+/* Space taken up by an entity, with quarter turns swapping its sides */
+void entityBounds(struct Entity *ent, SDL_Rect *out) {
+	int w = ent_sizes[ent->type][0];
+	int h = ent_sizes[ent->type][1];
+
+	out->x = ent->x;
+	out->y = ent->y;
+	out->w = w;
+	out->h = h;
+
+	if (ent->orientation % 2) {
+		out->x += (w - h) / 2;
+		out->y += (h - w) / 2;
+		out->w = h;
+		out->h = w;
 	}
+}
 
-	for (int j = 0; j < level->nodesUsed; j++) {
-		struct TankNode node = level->nodes[j];
-		struct SDL_Rect place = {level->nodes[j].x, level->nodes[j].y, 36, 36};
+/* Does anything solid overlap this area? */
+bool levelCollides(struct Level *level, const SDL_Rect *area) {
+	uint32_t hits[16];
+	int found = gridQueryRect(&level->grid, area, hits, 16);
 
-		SDL_RenderCopyEx(renderer, node_loadedTextures[node.type], NULL, &place,
-						 node.orientation, NULL, SDL_FLIP_NONE);
+	/* The index is keyed by slot, which always refers to a live entity */
+	for (int i = 0; i < found; i++) {
+		if (level->ents[level->slots[hits[i]].index].type == wall)
+			return true;
 	}
 
-	SDL_RenderCopyEx(renderer, placeholderNode, NULL, &mouserect, 0, NULL,
-					 SDL_FLIP_NONE);
+	return false;
 }
 
-void levelTick(struct Level *level, long milisTime) {
+/*
+** Textures come from the level rather than the entities, which may be
+** from a snapshot taken before the level was last reloaded. Everything is
+** drawn offset by the corner of whatever it's being drawn into.
+*/
+static void batchEntity(const struct Entity *ent, int offsetX, int offsetY) {
+	struct SDL_Rect place = {
+		ent->x - offsetX,
+		ent->y - offsetY,
+		ent_sizes[ent->type][0],
+		ent_sizes[ent->type][1],
+	};
+
+	batchAdd(ent_loadedTextures[ent->type], &place, ent->orientation * 90.0);
 }
 
-static bool levelFileParse(FILE *fp, struct Level *level) {
-	char curLine[PARSE_MAX_LINE_LENGTH];
+static void *snapshotGrow(void *array, uint32_t *capacity, uint32_t want,
+						  size_t size) {
+	if (want <= *capacity)
+		return array;
+
+	*capacity = want + want / 2;
+	array = realloc(array, size * *capacity);
+	if (!array) {
+		puts("E: Out of memory while taking world snapshot");
+		exit(1);
+	}
 
-	while (fgets(curLine, PARSE_MAX_LINE_LENGTH, fp) != NULL) {
-		char cmd = curLine[0];
-		char *data = curLine + 2;
+	return array;
+}
 
-		switch (cmd) {
-		case 's': /* Start coordinate */
-		{
-			level->startPoint[0] = strtoimax(strtok(data, ","), NULL, 10);
-			level->startPoint[1] = strtoimax(strtok(NULL, ","), NULL, 10);
-			break;
+/*
+** Copies what drawing needs into a snapshot for the main thread; see
+** sim.c. Walls rarely change, so they're only copied again when they do.
+*/
+void levelSnapshot(struct Level *level, struct WorldSnapshot *snap) {
+	bool copyStatic = snap->staticVersion != level->staticVersion;
+	uint32_t statics = 0, dynamics = 0;
+
+	for (uint32_t i = 0; i < level->entityCount; i++) {
+		if (ent_static[level->ents[i].type])
+			statics++;
+		else
+			dynamics++;
+	}
+
+	if (copyStatic) {
+		snap->statics = snapshotGrow(snap->statics, &snap->staticCapacity,
+									 statics, sizeof(struct Entity));
+		snap->staticCount = 0;
+	}
+
+	snap->dynamics = snapshotGrow(snap->dynamics, &snap->dynamicCapacity,
+								  dynamics, sizeof(struct Entity));
+	snap->dynamicCount = 0;
+
+	for (uint32_t i = 0; i < level->entityCount; i++) {
+		struct Entity *ent = &level->ents[i];
+
+		if (!ent_static[ent->type])
+			snap->dynamics[snap->dynamicCount++] = *ent;
+		else if (copyStatic)
+			snap->statics[snap->staticCount++] = *ent;
+	}
+
+	snap->staticVersion = level->staticVersion;
+
+	snap->nodes = snapshotGrow(snap->nodes, &snap->nodeCapacity,
+							   level->nodesUsed, sizeof(struct TankNode));
+	if (level->nodesUsed)
+		memcpy(snap->nodes, level->nodes,
+			   sizeof(struct TankNode) * level->nodesUsed);
+	snap->nodesUsed = level->nodesUsed;
+	snap->maxNodes = level->maxNodes;
+
+	snap->worldW = level->width;
+	snap->worldH = level->height;
+}
+
+/*
+** Drawing keeps its own copy of the walls from the last snapshot that
+** changed them, in a grid of its own, so finding the walls in some part of
+** the level only ever visits the walls that are there.
+*/
+static void levelSyncStatics(struct Level *level, struct WorldSnapshot *snap) {
+	if (level->viewVersion == snap->staticVersion)
+		return;
+
+	traceBegin("levelSyncStatics");
+
+	uint32_t count = snap->staticCount;
+	level->viewStatics =
+		realloc(level->viewStatics, sizeof(struct Entity) * (count + 1));
+	level->viewHits = realloc(level->viewHits, sizeof(uint32_t) * (count + 1));
+	if (!level->viewStatics || !level->viewHits) {
+		puts("E: Out of memory while indexing level walls");
+		exit(1);
+	}
+
+	memcpy(level->viewStatics, snap->statics, sizeof(struct Entity) * count);
+	level->viewStaticCount = count;
+
+	gridDestroy(&level->viewGrid);
+	gridInit(&level->viewGrid);
+	for (uint32_t i = 0; i < count; i++) {
+		SDL_Rect bounds;
+		entityBounds(&level->viewStatics[i], &bounds);
+		gridInsert(&level->viewGrid, i, &bounds);
+	}
+
+	level->viewVersion = snap->staticVersion;
+	level->staticDirty = true;
+
+	traceEnd("levelSyncStatics");
+}
+
+/* Every wall overlapping the area, relative to the given corner */
+static void batchStaticsIn(struct Level *level, const SDL_Rect *area,
+						   int offsetX, int offsetY) {
+	int found = gridQueryRect(&level->viewGrid, area, level->viewHits,
+							  (int)level->viewStaticCount);
+
+	for (int i = 0; i < found; i++)
+		batchEntity(&level->viewStatics[level->viewHits[i]], offsetX, offsetY);
+}
+
+/*
+** Walls are pre-drawn a chunk of the level at a time, into textures kept
+** for the chunks around the camera. A chunk is only drawn again when it
+** comes back into view or its walls change; otherwise a frame is just a
+** few copies, however many walls there are.
+**
+** If the renderer can't draw to textures, the walls in view are drawn
+** directly instead. The software renderer bakes the whole view in one go,
+** again whenever the camera moves.
+*/
+static bool chunksFailed = false;
+
+static struct StaticChunk *levelChunk(struct Level *level, int cx, int cy) {
+	struct StaticChunk *oldest = &level->chunks[0];
+
+	for (int i = 0; i < LEVEL_MAX_CHUNKS; i++) {
+		struct StaticChunk *chunk = &level->chunks[i];
+		if (chunk->texture && chunk->cx == cx && chunk->cy == cy) {
+			chunk->lastUsed = level->chunkClock;
+			return chunk;
 		}
-		case 'm': /* Node max */
-		{
-			level->maxNodes = strtoimax(data, NULL, 10);
-			level->nodes = malloc(sizeof(struct TankNode) * level->maxNodes);
-			break;
+
+		if (!chunk->texture || chunk->lastUsed < oldest->lastUsed)
+			oldest = chunk;
+	}
+
+	oldest->cx = cx;
+	oldest->cy = cy;
+	oldest->valid = false;
+	oldest->lastUsed = level->chunkClock;
+
+	return oldest;
+}
+
+static bool levelBakeChunk(struct Level *level, struct StaticChunk *chunk) {
+	if (!chunk->texture) {
+		chunk->texture = SDL_CreateTexture(
+			renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+			LEVEL_CHUNK_SIZE, LEVEL_CHUNK_SIZE);
+		if (!chunk->texture) {
+			printf("W: Could not create level chunk, drawing walls "
+				   "directly\nError message: %s\n",
+				   SDL_GetError());
+			chunksFailed = true;
+			return false;
 		}
-		case 'w': /* Wall declaration */
-		{
-			int x = strtoimax(strtok(data, ","), NULL, 10);
-			int y = strtoimax(strtok(NULL, ","), NULL, 10);
-			int orientation = strtoimax(strtok(NULL, ","), NULL, 10);
-
-			if (addEntity(level, wall, 100, false, x, y, (uint8_t)orientation) <
-				0) {
-				puts("E: Maximum entity count exceeded; could not declare "
-					 "wall!");
+
+		SDL_SetTextureBlendMode(chunk->texture, SDL_BLENDMODE_BLEND);
+	}
+
+	traceBegin("levelBakeChunk");
+
+	uint8_t r, g, b, a;
+	float sx, sy;
+	SDL_Texture *oldTarget = SDL_GetRenderTarget(renderer);
+	SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+	SDL_RenderGetScale(renderer, &sx, &sy);
+
+	SDL_SetRenderTarget(renderer, chunk->texture);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+
+	SDL_Rect area = {
+		chunk->cx * LEVEL_CHUNK_SIZE,
+		chunk->cy * LEVEL_CHUNK_SIZE,
+		LEVEL_CHUNK_SIZE,
+		LEVEL_CHUNK_SIZE,
+	};
+
+	batchBegin();
+	batchStaticsIn(level, &area, area.x, area.y);
+	batchFlush();
+
+	SDL_SetRenderDrawColor(renderer, r, g, b, a);
+	SDL_SetRenderTarget(renderer, oldTarget);
+
+	/* Changing targets resets the scale, which the scene target needs */
+	if (oldTarget)
+		SDL_RenderSetScale(renderer, sx, sy);
+
+	chunk->valid = true;
+	traceEnd("levelBakeChunk");
+	return true;
+}
+
+/* False if the walls couldn't be drawn this way */
+static bool levelDrawChunks(struct Level *level, const SDL_Rect *camera) {
+	if (chunksFailed || !SDL_RenderTargetSupported(renderer))
+		return false;
+
+	if (level->staticDirty) {
+		for (int i = 0; i < LEVEL_MAX_CHUNKS; i++)
+			level->chunks[i].valid = false;
+		level->staticDirty = false;
+	}
+
+	/* The camera never leaves the level, so never goes below zero */
+	int x0 = camera->x / LEVEL_CHUNK_SIZE;
+	int y0 = camera->y / LEVEL_CHUNK_SIZE;
+	int x1 = (camera->x + camera->w - 1) / LEVEL_CHUNK_SIZE;
+	int y1 = (camera->y + camera->h - 1) / LEVEL_CHUNK_SIZE;
+
+	level->chunkClock++;
+
+	for (int cy = y0; cy <= y1; cy++) {
+		for (int cx = x0; cx <= x1; cx++) {
+			struct StaticChunk *chunk = levelChunk(level, cx, cy);
+			if (!chunk->valid && !levelBakeChunk(level, chunk))
 				return false;
-			}
-			break;
+
+			SDL_Rect place = {
+				cx * LEVEL_CHUNK_SIZE - camera->x,
+				cy * LEVEL_CHUNK_SIZE - camera->y,
+				LEVEL_CHUNK_SIZE,
+				LEVEL_CHUNK_SIZE,
+			};
+			SDL_RenderCopy(renderer, chunk->texture, NULL, &place);
 		}
-		case '#': /* Comment */
-			break;
-		case '\n':
-			break;
-		default:
+	}
+
+	return true;
+}
+
+/* The software renderer's layer is the view itself, opaque */
+static void levelSoftStatics(struct Level *level, const SDL_Rect *camera) {
+	if (level->staticDirty || softBakeStale() ||
+		!SDL_RectEquals(&level->bakedView, camera)) {
+		softBakeBegin();
+		batchStaticsIn(level, camera, camera->x, camera->y);
+		softBakeEnd();
+
+		level->bakedView = *camera;
+		level->staticDirty = false;
+	}
+
+	softDrawBaked();
+}
+
+/*
+** Draws the level as of a snapshot, not as it is right now, and only the
+** part of it the camera can see. Entities that move are few enough to
+** just be checked against the view one by one.
+*/
+void levelRender(struct Level *level, struct WorldSnapshot *snap,
+				 const SDL_Rect *camera) {
+	int x, y;
+	struct SDL_Rect mouserect;
+	getMousePosition(&x, &y);
+	mouserect.w = 32;
+	mouserect.h = 32;
+	mouserect.x = x; /* - (mouserect.w / 2); */
+	mouserect.y = y; /* - (mouserect.h / 2); */
+
+	levelSyncStatics(level, snap);
+
+	bool wallsDrawn = true;
+	if (softEnabled())
+		levelSoftStatics(level, camera);
+	else
+		wallsDrawn = levelDrawChunks(level, camera);
+
+	batchBegin();
+
+	if (!wallsDrawn)
+		batchStaticsIn(level, camera, camera->x, camera->y);
+
+	for (uint32_t i = 0; i < snap->dynamicCount; i++) {
+		SDL_Rect bounds;
+		entityBounds(&snap->dynamics[i], &bounds);
+
+		if (SDL_HasIntersection(&bounds, camera))
+			batchEntity(&snap->dynamics[i], camera->x, camera->y);
+	}
+
+	for (int j = 0; j < snap->nodesUsed; j++) {
+		struct TankNode *node = &snap->nodes[j];
+		struct SDL_Rect place = {node->x, node->y, 36, 36};
+		if (!SDL_HasIntersection(&place, camera))
+			continue;
+
+		place.x -= camera->x;
+		place.y -= camera->y;
+		batchAdd(node_loadedTextures[node->type], &place, node->orientation);
+	}
+
+	batchFlush();
+
+	/* Sprites are drawn as they're added in software, so this is in order */
+	if (softEnabled())
+		batchAdd(placeholderNode, &mouserect, 0);
+	else
+		SDL_RenderCopyEx(renderer, placeholderNode->texture, NULL, &mouserect,
+						 0, NULL, SDL_FLIP_NONE);
+}
+
+/* The mouse is on the screen, but nodes go in the world under it */
+void levelTick(struct Level *level, long milisTime) {
+	int x, y;
+	getTickMousePosition(&x, &y);
+	cameraToWorld(&level->camera, x, y, &x, &y);
+
+	if (isMouseClicked(SDL_BUTTON_LEFT) && level->nodesUsed < level->maxNodes) {
+		level->nodes[level->nodesUsed].type = move;
+		level->nodes[level->nodesUsed].x = x;
+		level->nodes[level->nodesUsed].y = y;
+		level->nodes[level->nodesUsed].orientation = 0;
+
+		level->nodesUsed++;
+	}
+}
+
+/* Entities are left without textures; levelLoadFinish hands them out */
+static bool levelPopulate(struct Level *level, struct LevelFile *file,
+						  struct LevelLoad *load) {
+	const struct LevelHeader *header = &file->header;
+	int typeCount = sizeof(ent_textures) / sizeof(ent_textures[0]);
+
+	level->startPoint[0] = header->start[0];
+	level->startPoint[1] = header->start[1];
+
+	level->maxNodes = header->maxNodes;
+	level->nodes = malloc(sizeof(struct TankNode) * (level->maxNodes + 1));
+
+	/* Size storage up front rather than doubling our way there */
+	level->entityCapacity = header->entityCount;
+	level->ents = malloc(sizeof(struct Entity) * (level->entityCapacity + 1));
+	level->slotCapacity = header->entityCount;
+	level->slots =
+		malloc(sizeof(struct EntitySlot) * (level->slotCapacity + 1));
+
+	if (!level->nodes || !level->ents || !level->slots) {
+		puts("E: Out of memory while loading level");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < header->entityCount; i++) {
+		const struct LevelRecord *rec = &file->records[i];
+		if (rec->type >= typeCount)
 			return false;
+
+		insertEntity(level, rec->type, rec->health, rec->canDamage, rec->x,
+					 rec->y, rec->orientation, NULL);
+
+		/* Publishing progress per entity would just be contention */
+		if ((i & 1023) == 1023) {
+			SDL_AtomicSet(&load->done, (int)i + 1);
+			if (SDL_AtomicGet(&load->cancelled))
+				return false;
 		}
 	}
 
+	SDL_AtomicSet(&load->done, (int)header->entityCount);
+
 	return true;
 }
@@ -0,0 +1,348 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Level file loading and compiling routines
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tank.h"
+
+/*
+** Levels come in two forms. The text form (levels/levelN.txt) is what
+** gets edited by hand. The binary form (levels/levelN.lvl) is produced
+** from it by "tank-game -c" and is just a LevelHeader followed by
+** entityCount LevelRecords, in host byte order, so it can be mapped
+** straight into memory and used without any parsing at all.
+**
+** Both are loaded into a LevelFile, which levelInit then builds the level
+** from. For a binary file the records point into the mapping itself.
+*/
+static const char lvl_magic[4] = {'T', 'N', 'K', 'L'};
+static const uint32_t lvl_byteOrder = 0x01020304;
+
+static bool levelFileParse(FILE *fp, struct LevelFile *file);
+
+static void levelFilePath(char *buf, size_t len, uint32_t levelID,
+						  const char *ext) {
+	snprintf(buf, len, "levels/level%u.%s", levelID, ext);
+}
+
+static void levelFileReset(struct LevelFile *file) {
+	memset(&file->header, 0, sizeof(file->header));
+	memcpy(file->header.magic, lvl_magic, sizeof(lvl_magic));
+	file->header.byteOrder = lvl_byteOrder;
+	file->header.version = LVL_FILE_VERSION;
+
+	file->records = NULL;
+	file->owned = NULL;
+	file->ownedCapacity = 0;
+	file->map = NULL;
+	file->mapSize = 0;
+}
+
+/* Uses a compiled level already in memory, records and all, in place */
+static bool levelFileUse(struct LevelFile *file, const void *data, size_t size,
+						 const char *path) {
+	if (size < sizeof(struct LevelHeader))
+		return false;
+
+	const struct LevelHeader *header = data;
+	size_t space =
+		(size - sizeof(struct LevelHeader)) / sizeof(struct LevelRecord);
+
+	if (memcmp(header->magic, lvl_magic, sizeof(lvl_magic)) != 0 ||
+		header->byteOrder != lvl_byteOrder ||
+		header->version != LVL_FILE_VERSION || header->entityCount > space ||
+		header->maxNodes < 0 || header->maxNodes > LVL_MAX_NODES) {
+		printf("W: Ignoring unusable compiled level \"%s\"\n", path);
+		return false;
+	}
+
+	file->header = *header;
+	file->records = (const struct LevelRecord *)(header + 1);
+
+	return true;
+}
+
+static bool levelFileMap(struct LevelFile *file, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct LevelHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	if (!levelFileUse(file, map, st.st_size, path)) {
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	file->map = map;
+	file->mapSize = st.st_size;
+
+	return true;
+}
+
+/* Looks for the level in the pack archive, compiled form first */
+static bool levelFileFromPack(struct LevelFile *file, const char *binName,
+							  const char *textName) {
+	const void *data;
+	size_t size;
+
+	if (packFind(binName, &data, &size) &&
+		levelFileUse(file, data, size, binName)) {
+		snprintf(file->path, sizeof(file->path), "%s", binName);
+		return true;
+	}
+
+	if (!packFind(textName, &data, &size))
+		return false;
+
+	/* The parser only reads, whatever fmemopen's prototype says */
+	FILE *fp = fmemopen((void *)data, size, "r");
+	if (!fp)
+		return false;
+
+	snprintf(file->path, sizeof(file->path), "%s", textName);
+
+	traceBegin("levelFileParse");
+	bool valid = levelFileParse(fp, file);
+	traceEnd("levelFileParse");
+	fclose(fp);
+
+	if (!valid)
+		levelFileClose(file);
+
+	return valid;
+}
+
+/* Is the compiled level older than the text it came from? */
+static bool levelFileStale(const char *binPath, const char *textPath) {
+	struct stat bin, text;
+	if (stat(binPath, &bin) < 0 || stat(textPath, &text) < 0)
+		return false;
+
+	return text.st_mtime > bin.st_mtime;
+}
+
+bool levelFileOpen(struct LevelFile *file, uint32_t levelID) {
+	char binName[64], textName[64];
+	levelFilePath(binName, sizeof(binName), levelID, "lvl");
+	levelFilePath(textName, sizeof(textName), levelID, "txt");
+
+	levelFileReset(file);
+
+	if (levelFileFromPack(file, binName, textName))
+		return true;
+
+	/* Not packed; fall back to loose files, wherever they turn up */
+	char binPath[LVL_MAX_PATH], textPath[LVL_MAX_PATH];
+	packLoosePath(binName, binPath, sizeof(binPath));
+	packLoosePath(textName, textPath, sizeof(textPath));
+
+	traceBegin("levelFileMap");
+	bool mapped =
+		!levelFileStale(binPath, textPath) && levelFileMap(file, binPath);
+	traceEnd("levelFileMap");
+
+	if (mapped) {
+		snprintf(file->path, sizeof(file->path), "%s", binPath);
+		return true;
+	}
+
+	snprintf(file->path, sizeof(file->path), "%s", textPath);
+	return levelFileLoadText(file, textPath);
+}
+
+bool levelFileLoadText(struct LevelFile *file, const char *path) {
+	levelFileReset(file);
+
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+
+	traceBegin("levelFileParse");
+	bool valid = levelFileParse(fp, file);
+	traceEnd("levelFileParse");
+	fclose(fp);
+
+	if (!valid)
+		levelFileClose(file);
+
+	return valid;
+}
+
+void levelFileClose(struct LevelFile *file) {
+	if (file->map)
+		munmap(file->map, file->mapSize);
+
+	free(file->owned);
+
+	file->map = NULL;
+	file->owned = NULL;
+	file->records = NULL;
+}
+
+bool levelFileWrite(const struct LevelFile *file, const char *path) {
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+
+	bool ok = fwrite(&file->header, sizeof(file->header), 1, fp) == 1;
+	if (ok && file->header.entityCount)
+		ok = fwrite(file->records, sizeof(struct LevelRecord),
+					file->header.entityCount,
+					fp) == file->header.entityCount;
+
+	if (fclose(fp) != 0)
+		ok = false;
+
+	return ok;
+}
+
+/*
+** Turns levels/levelN.txt into levels/levelN.lvl, or any other path into
+** the same path with its extension swapped.
+*/
+int levelCompile(const char *textPath) {
+	struct LevelFile file;
+	if (!levelFileLoadText(&file, textPath)) {
+		printf("E: Could not read level file \"%s\"\n", textPath);
+		return 1;
+	}
+
+	char binPath[256];
+	const char *dot = strrchr(textPath, '.');
+	int stem = dot ? (int)(dot - textPath) : (int)strlen(textPath);
+	snprintf(binPath, sizeof(binPath), "%.*s.lvl", stem, textPath);
+
+	bool ok = levelFileWrite(&file, binPath);
+	if (ok)
+		printf("Compiled %u entities from \"%s\" to \"%s\"\n",
+			   file.header.entityCount, textPath, binPath);
+	else
+		printf("E: Could not write \"%s\": %s\n", binPath, strerror(errno));
+
+	levelFileClose(&file);
+	return ok ? 0 : 1;
+}
+
+static bool levelFileAppend(struct LevelFile *file, struct LevelRecord *rec) {
+	if (file->header.entityCount == file->ownedCapacity) {
+		file->ownedCapacity =
+			file->ownedCapacity ? file->ownedCapacity * 2 : 64;
+		struct LevelRecord *grown = realloc(
+			file->owned, sizeof(struct LevelRecord) * file->ownedCapacity);
+		if (!grown)
+			return false;
+
+		file->owned = grown;
+		file->records = grown;
+	}
+
+	file->owned[file->header.entityCount++] = *rec;
+	return true;
+}
+
+/* Reads the next comma separated integer, failing on anything else */
+static bool parseInt(char **cursor, int32_t *out) {
+	char *end;
+	errno = 0;
+	long val = strtol(*cursor, &end, 10);
+	if (end == *cursor || errno == ERANGE || val < INT32_MIN ||
+		val > INT32_MAX)
+		return false;
+
+	while (*end == ' ' || *end == '\t')
+		end++;
+	if (*end == ',')
+		end++;
+
+	*out = (int32_t)val;
+	*cursor = end;
+	return true;
+}
+
+static bool levelFileParse(FILE *fp, struct LevelFile *file) {
+	char *curLine = NULL;
+	size_t lineCap = 0;
+	bool valid = true;
+
+	while (valid && getline(&curLine, &lineCap, fp) >= 0) {
+		char cmd = curLine[0];
+		char *data = curLine[0] ? curLine + 1 : curLine;
+
+		switch (cmd) {
+		case 's': /* Start coordinate */
+		{
+			valid = parseInt(&data, &file->header.start[0]) &&
+					parseInt(&data, &file->header.start[1]);
+			break;
+		}
+		case 'm': /* Node max */
+		{
+			valid = parseInt(&data, &file->header.maxNodes) &&
+					file->header.maxNodes >= 0 &&
+					file->header.maxNodes <= LVL_MAX_NODES;
+			break;
+		}
+		case 'w': /* Wall declaration */
+		{
+			int32_t x, y, orientation;
+			valid = parseInt(&data, &x) && parseInt(&data, &y) &&
+					parseInt(&data, &orientation);
+			if (!valid)
+				break;
+
+			struct LevelRecord rec = {
+				.type = wall,
+				.orientation = (uint8_t)orientation,
+				.health = 100,
+				.canDamage = false,
+				.x = x,
+				.y = y,
+			};
+
+			if (!levelFileAppend(file, &rec)) {
+				puts("E: Out of memory while reading level file");
+				valid = false;
+			}
+			break;
+		}
+		case '#': /* Comment */
+			break;
+		case '\r': /* FALLTHROUGH */
+		case '\n':
+			break;
+		default:
+			valid = false;
+			break;
+		}
+	}
+
+	free(curLine);
+	return valid;
+}
@@ -4,6 +4,8 @@
  * Copyright 2021 - Ethan Marshall
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -22,6 +24,7 @@
 
 static const uint32_t sdl_systems =
 	SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS | SDL_INIT_TIMER;
+static const uint32_t sdl_headlessSystems = SDL_INIT_EVENTS | SDL_INIT_TIMER;
 static const uint32_t sdl_winflags = 0;
 static const uint32_t sdl_rendflags = SDL_RENDERER_ACCELERATED;
 
@@ -33,19 +36,52 @@ static const int h = 720;
 
 static double maxtps = 60.0;
 
+/* Frame pacing; a target of zero means "match the display" */
+static bool vsync = false;
+static double targetFps = 0;
+
+/* Run the simulation with no window for this many ticks, then exit */
+static bool headless = false;
+static long headlessTicks = 0;
+static struct SDL_Surface *headlessSurface;
+
+/* Skip the GPU and draw the scene on the CPU; see soft.c */
+static bool software = false;
+
+/* Draw the scene at lower resolution when frames take too long */
+static bool dynamicRes = true;
+
+/* Watch levels and textures for changes, and reload them as they happen */
+static bool devMode = false;
+
+/* Where to keep decoded textures between runs, if anywhere */
+static char *texCachePath = NULL;
+
+/* Input replay files to write out, or to play back instead of live input */
+static char *recordPath = NULL;
+static char *replayPath = NULL;
+
 bool running = false;
 bool focused = true;
 
-uint32_t ticks = 0;
+/* Ticks can run on the simulation thread, so are counted atomically */
+static SDL_atomic_t ticks;
 uint32_t frames = 0;
 
-uint64_t tickCount = 0;
+/* Set by whichever thread runs the last tick of a replay */
+static SDL_atomic_t replayEnded;
+
+/* Also counted on the simulation thread, and read from either */
+SDL_atomic_t tickCount;
+/* Menus tick too; the game clock counts from here so replays match */
+static uint32_t gameStartTick = 0;
 enum GameState state = fsMenu;
 struct Menu *currentMenu;
 
 int currentLevel = 1;
 static struct Player player;
 static struct Level level;
+struct LevelLoad levelLoad;
 
 struct SDL_Window *window;
 struct SDL_Renderer *renderer;
@@ -62,6 +98,90 @@ void printHelp() {
 	printBanner();
 	puts("\nRun with no arguments to run the stock game");
 	puts("Run with arguments to set options for the game:\n");
+	puts("  -c FILE\tCompile a text level file into its binary form and "
+		 "exit");
+	puts("  -H TICKS\tRun TICKS game ticks with no window, report the tick "
+		 "rate and exit");
+	puts("  -l LEVEL\tStart at level number LEVEL");
+	puts("  -r FILE\tRecord all game input to FILE");
+	puts("  -p FILE\tPlay back input recorded to FILE, then exit");
+	puts("  -t FILE\tWrite a Chrome/Perfetto trace of the run to FILE");
+	puts("  -v\t\tWait for vsync instead of pacing frames ourselves");
+	puts("  -f FPS\tCap the frame rate at FPS, or -1 for no cap");
+	puts("  -D DIR\tCache decoded textures in DIR to speed up later starts");
+	puts("  -w\t\tDev mode: reload levels and textures when they change");
+	puts("  -s\t\tDraw in software, as happens when there is no GPU");
+	puts("  -x\t\tAlways draw the level at full resolution");
+	puts("  -h\t\tShow this help and exit");
+}
+
+/*
+** Parsed before any of SDL is brought up, so options that do their job
+** and exit never need a display.
+*/
+static void parseArgs(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "c:H:l:r:p:t:vf:D:wsxh")) != -1) {
+		switch (opt) {
+		case 'c':
+			exit(levelCompile(optarg));
+		case 'H':
+			headless = true;
+			headlessTicks = strtol(optarg, NULL, 10);
+			if (headlessTicks <= 0) {
+				puts("E: Headless tick count must be a positive number");
+				exit(1);
+			}
+			break;
+		case 'l':
+			currentLevel = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			recordPath = optarg;
+			break;
+		case 'p':
+			replayPath = optarg;
+			break;
+		case 't':
+			traceOpen(optarg);
+			break;
+		case 'v':
+			vsync = true;
+			break;
+		case 'f':
+			targetFps = strtod(optarg, NULL);
+			break;
+		case 'D':
+			texCachePath = optarg;
+			break;
+		case 'w':
+			devMode = true;
+			break;
+		case 's':
+			software = true;
+			break;
+		case 'x':
+			dynamicRes = false;
+			break;
+		case 'h':
+			printHelp();
+			exit(0);
+		default:
+			printHelp();
+			exit(1);
+		}
+	}
+
+	if (recordPath && replayPath) {
+		puts("E: Cannot record and play back input at the same time");
+		exit(1);
+	}
+
+	/* Replays decide the level and tick rate themselves */
+	if (replayPath && !replayPlayStart(replayPath, &currentLevel, &maxtps)) {
+		printf("E: Could not read replay \"%s\"\n", replayPath);
+		exit(1);
+	}
 }
 
 void initSDL(uint32_t systems) {
@@ -77,7 +197,20 @@ void initSDL(uint32_t systems) {
 		exit(1);
 	}
 
-	programFont = TTF_OpenFont(programFontPath, 72);
+	/* Must happen before images are decoded on more than one thread */
+	if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+		printf("E: Failed to initialise image loading!\nError message: %s\n",
+			   IMG_GetError());
+		exit(1);
+	}
+
+	/* Dev mode works on the loose files, which are what get edited */
+	if (!devMode && packOpen())
+		puts("DEBUG: Reading game data from pack archive");
+
+	/* Fonts read from the archive for as long as they're open */
+	SDL_RWops *fontData = packOpenRW(programFontPath);
+	programFont = fontData ? TTF_OpenFontRW(fontData, 1, 72) : NULL;
 
 	if (!programFont) {
 		printf("E: Failed to load required game fonts! Check your game "
@@ -86,6 +219,27 @@ void initSDL(uint32_t systems) {
 		exit(1);
 	}
 
+	/*
+	 * With no display, draw into a plain surface instead. Textures still
+	 * load and level setup runs exactly as it would with a window.
+	 */
+	if (headless) {
+		headlessSurface = SDL_CreateRGBSurfaceWithFormat(
+			0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+		if (headlessSurface)
+			renderer = SDL_CreateSoftwareRenderer(headlessSurface);
+
+		if (!renderer) {
+			printf("E: Failed to set up headless renderer!\nError message: "
+				   "%s\n",
+				   SDL_GetError());
+			quitSDL();
+			exit(1);
+		}
+
+		return;
+	}
+
 	window = SDL_CreateWindow(name, x, y, w, h, sdl_winflags);
 	if (!window) {
 		printf("E: Failed to set up display!\nError message: %s\n",
@@ -94,76 +248,237 @@ void initSDL(uint32_t systems) {
 		exit(1);
 	}
 
-	renderer = SDL_CreateRenderer(window, -1, sdl_rendflags);
+	uint32_t flags = vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+	if (!software) {
+		renderer = SDL_CreateRenderer(window, -1, sdl_rendflags | flags);
+		if (!renderer)
+			printf("W: No accelerated renderer, drawing in software\nError "
+				   "message: %s\n",
+				   SDL_GetError());
+	}
+
+	if (!renderer)
+		renderer =
+			SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE | flags);
+
 	if (!renderer) {
 		printf("E: Failed to set up renderer!\nError message: %s\n",
 			   SDL_GetError());
 		quitSDL();
 		exit(1);
 	}
-}
 
-void quitSDL() {
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
+	/* Some drivers hand back a software renderer without being asked */
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(renderer, &info) == 0 &&
+		(info.flags & SDL_RENDERER_SOFTWARE))
+		softInit(w, h);
 
-	TTF_CloseFont(programFont);
-	TTF_Quit();
+	scaleInit(w, h, dynamicRes);
+}
 
-	SDL_Quit();
+void quitSDL() {
+	/* Nothing may tick a level that's being torn down */
+	simStop();
 
+	/* Game state holds textures, so must go before the renderer */
 	switch (state) {
 	case game:
 		levelDestroy(&level);
+		tankDestroy(&player);
 		break;
 	case fsMenu: /* FALLTHROUGH */
 	case olMenu:
 		menuDestroy(currentMenu);
 		break;
+	case loading:
+		levelLoadCancel(&levelLoad);
+		menuDestroy(currentMenu);
+		break;
 	default: /* This is fine */
 		break;
 	}
+
+	replayStop();
+	hotDestroy();
+	textDestroy();
+	assetsDestroy();
+	batchDestroy();
+	scaleDestroy();
+	softDestroy();
+
+	SDL_DestroyRenderer(renderer);
+	if (window)
+		SDL_DestroyWindow(window);
+	if (headlessSurface)
+		SDL_FreeSurface(headlessSurface);
+
+	TTF_CloseFont(programFont);
+	TTF_Quit();
+	IMG_Quit();
+	texCacheDestroy();
+	packClose();
+
+	SDL_Quit();
 }
 
+/*
+** The level loads in the background while the loader menu stays live;
+** tick() finishes the job once the loader is done.
+*/
 void startGame() {
+	traceBegin("startGame");
 	menuDestroy(currentMenu);
 
 	createLoaderMenu();
-	render();
+	state = loading;
+
+	levelLoadStart(&levelLoad, &level, currentLevel, true);
+
+	traceEnd("startGame");
+}
+
+/*
+** Swaps in a freshly loaded copy of the current level, leaving the player
+** where they were. If the new file doesn't load, the old level stays.
+*/
+static void reloadLevel() {
+	struct LevelLoad load;
+	struct Level fresh;
+
+	levelLoadStart(&load, &fresh, currentLevel, false);
+	if (load.failed) {
+		printf("W: Level %i has errors; keeping the old one\n", currentLevel);
+		levelLoadCancel(&load);
+		return;
+	}
+
+	simLock();
+	int x = player.x, y = player.y;
+
+	levelDestroy(&level);
+	levelLoadFinish(&load, &player);
+	level = fresh;
+
+	player.x = player.prevX = x;
+	player.y = player.prevY = y;
+
+	simPublish();
+	simUnlock();
+}
+
+static void hotReload() {
+	int changed = hotPoll();
+	if ((changed & HOT_TEXTURE) && currentMenu && state != game)
+		menuInvalidate(currentMenu);
+
+	if (state != game && state != olMenu)
+		return;
+
+	if (changed & HOT_LEVEL)
+		reloadLevel();
+	else if (changed & HOT_TEXTURE)
+		levelInvalidateStatic(&level);
+}
 
+static void finishLoading() {
+	traceBegin("finishLoading");
+
+	simLock();
 	tankInit(&player);
-	levelInit(&level, &player, currentLevel);
+	levelLoadFinish(&levelLoad, &player);
+
+	/* So the first frame already has something to draw */
+	simPublish();
+	gameStartTick = (uint32_t)SDL_AtomicGet(&tickCount);
+	simUnlock();
 
+	menuDestroy(currentMenu);
 	state = game;
 	currentMenu = NULL;
+
+	if (recordPath && !replayRecordStart(recordPath, currentLevel, maxtps))
+		printf("W: Could not record input to \"%s\"\n", recordPath);
+
+	simSetActive(true);
+	traceEnd("finishLoading");
 }
 
 void init() {
 	initRandom();
 
+	if (!textInit(programFontPath)) {
+		printf("E: Failed to build text atlas!\nError message: %s\n",
+			   SDL_GetError());
+		quitSDL();
+		exit(1);
+	}
+
+	if (texCachePath)
+		texCacheInit(texCachePath);
+	assetsPreload();
+
 	running = true;
 
 	state = fsMenu;
 	createMainMenu();
+
+	/* Replays start from the level itself; the menu was never recorded */
+	if (replayPlaying())
+		startGame();
+}
+
+/*
+** The level and everything on it, through whichever renderer is in use and
+** at whatever resolution is keeping up; see scale.c.
+*/
+static void sceneRender(struct WorldSnapshot *world) {
+	scaleUpdate();
+	scaleBegin();
+
+	/* How far we are between the last tick and the next */
+	double alpha = simAlpha(world);
+
+	/* Follows the tank as drawn, so the two never drift apart */
+	float x, y;
+	SDL_Rect camera;
+	tankFocus(&world->player, alpha, &x, &y);
+	cameraFollow(&camera, world->worldW, world->worldH, x, y);
+
+	profileBegin(PROF_LEVEL_RENDER);
+	levelRender(&level, world, &camera);
+	profileEnd(PROF_LEVEL_RENDER);
+
+	profileBegin(PROF_TANK_RENDER);
+	tankRender(&world->player, alpha, &camera);
+	profileEnd(PROF_TANK_RENDER);
+
+	scaleEnd();
 }
 
 void render() {
+	profileBegin(PROF_RENDER);
 	SDL_RenderClear(renderer);
 
+	/* The game as of its last tick, never one half run */
+	struct WorldSnapshot *world = simLatest();
+
 	switch (state) {
-	case fsMenu:
+	case fsMenu: /* FALLTHROUGH */
+	case loading:
+		profileBegin(PROF_MENU_RENDER);
 		menuRender(currentMenu);
+		profileEnd(PROF_MENU_RENDER);
 		break;
 	case olMenu:
-		menuRender(currentMenu);
+		sceneRender(world);
 
-		tankRender(&player);
-		levelRender(&level);
+		profileBegin(PROF_MENU_RENDER);
+		menuRender(currentMenu);
+		profileEnd(PROF_MENU_RENDER);
 		break;
 	case game:
-		levelRender(&level);
-		tankRender(&player);
-		HUDRender(&level);
+		sceneRender(world);
 		break;
 	case failure:
 		break;
@@ -174,26 +489,96 @@ void render() {
 		exit(1);
 	}
 
+	/* Always drawn, so the profiler overlay works in menus too */
+	profileBegin(PROF_HUD_RENDER);
+	HUDRender(state == game ? world : NULL);
+	profileEnd(PROF_HUD_RENDER);
+
+	profileBegin(PROF_PRESENT);
 	SDL_RenderPresent(renderer);
+	profileEnd(PROF_PRESENT);
+
+	profileEnd(PROF_RENDER);
 }
 
-void tick() {
-	tickCount++;
+static void menuStep() {
+	profileBegin(PROF_MENU_TICK);
+	tweensTick(1000.0f / maxtps);
+	menuTick(currentMenu);
+	profileEnd(PROF_MENU_TICK);
+}
 
-	long now = SDL_GetTicks();
+/*
+** One tick of the level and player. With a simulation thread this runs
+** there, holding simLock; see sim.c.
+*/
+static void gameTick() {
+	profileBegin(PROF_TICK);
+	SDL_AtomicAdd(&ticks, 1);
+
+	replayFeed();
+	inputBeginTick();
+	uint32_t gameTicks =
+		(uint32_t)SDL_AtomicAdd(&tickCount, 1) + 1 - gameStartTick;
+
+	/* Game time only moves with ticks, so replays see the same clock */
+	long now = (long)((uint64_t)gameTicks * 1000 / maxtps);
+
+	profileBegin(PROF_LEVEL_TICK);
+	levelTick(&level, now);
+	profileEnd(PROF_LEVEL_TICK);
+
+	profileBegin(PROF_TANK_TICK);
+	tankTick(&player, &level, now);
+	profileEnd(PROF_TANK_TICK);
+
+	/* Where the next tick's mouse input lands in the world */
+	float x, y;
+	tankFocus(&player, 1.0, &x, &y);
+	cameraFollow(&level.camera, level.width, level.height, x, y);
+
+	profileEnd(PROF_TICK);
+
+	if (replayFinished())
+		SDL_AtomicSet(&replayEnded, 1);
+}
 
+void tick() {
 	switch (state) {
+	case loading:
+		/* Nothing simulates while loading, so the game clock waits as well */
+		profileBegin(PROF_TICK);
+		SDL_AtomicAdd(&ticks, 1);
+
+		inputBeginTick();
+		menuStep();
+
+		if (levelLoadDone(&levelLoad))
+			finishLoading();
+
+		profileEnd(PROF_TICK);
+		break;
 	case fsMenu:
-		menuTick(currentMenu);
+		profileBegin(PROF_TICK);
+		SDL_AtomicAdd(&ticks, 1);
+
+		replayFeed();
+		inputBeginTick();
+		SDL_AtomicAdd(&tickCount, 1);
+
+		menuStep();
+		profileEnd(PROF_TICK);
 		break;
 	case olMenu:
-		menuTick(currentMenu);
-		levelTick(&level, now);
-		tankTick(&player, now);
-		break;
+		menuStep();
+		/* FALLTHROUGH */
 	case game:
-		levelTick(&level, now);
-		tankTick(&player, now);
+		/* Otherwise the simulation thread keeps its own time */
+		if (!simThreaded()) {
+			gameTick();
+			simPublish();
+		}
+		break;
 	case failure:
 		break;
 	case success:
@@ -204,24 +589,56 @@ void tick() {
 	}
 }
 
+/* Only full-screen menus go idle; anything else is always moving */
+static bool menuIdle() {
+	return state == fsMenu && currentMenu && !menuDirty(currentMenu) &&
+		   !HUDProfilerShown();
+}
+
 void handleEvents() {
+	profileBegin(PROF_EVENTS);
+
 	SDL_Event e;
 	while (SDL_PollEvent(&e) > 0) {
+		if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3 &&
+			!e.key.repeat) {
+			HUDToggleProfiler();
+			if (currentMenu)
+				menuInvalidate(currentMenu);
+		}
+
+		/* During a replay, all input comes from the replay file */
+		if (replayPlaying() &&
+			(e.type == SDL_KEYDOWN || e.type == SDL_KEYUP ||
+			 e.type == SDL_MOUSEMOTION || e.type == SDL_MOUSEBUTTONDOWN ||
+			 e.type == SDL_MOUSEBUTTONUP))
+			continue;
+
 		switch (e.type) {
 		case SDL_QUIT:
 			running = false;
 			break;
 		case SDL_KEYDOWN:
-			updateKeys(e.key.keysym.sym, true);
+			if (!e.key.repeat)
+				updateKeys(e.key.keysym.scancode, true);
 			break;
 		case SDL_KEYUP:
-			updateKeys(e.key.keysym.sym, false);
+			updateKeys(e.key.keysym.scancode, false);
 			break;
 		case SDL_MOUSEBUTTONDOWN:
-			updateMice(e.button.button, true);
+			updateMice(e.button.button, true, e.button.x, e.button.y);
 			break;
 		case SDL_MOUSEBUTTONUP:
-			updateMice(e.button.button, false);
+			updateMice(e.button.button, false, e.button.x, e.button.y);
+			break;
+		case SDL_MOUSEMOTION:
+			updateMouse(e.motion.x, e.motion.y);
+			break;
+		case SDL_RENDER_TARGETS_RESET: /* FALLTHROUGH */
+		case SDL_RENDER_DEVICE_RESET:
+			/* Anything drawn into a texture has been lost */
+			if (state == game)
+				levelInvalidateStatic(&level);
 			break;
 		case SDL_WINDOWEVENT:
 			switch (e.window.event) {
@@ -236,43 +653,141 @@ void handleEvents() {
 			}
 			break;
 		}
+
+		/* Menus answer events as they arrive rather than once a tick */
+		if (currentMenu &&
+			(state == fsMenu || state == olMenu || state == loading))
+			menuHandleEvent(currentMenu, &e);
 	}
+
+	profileEnd(PROF_EVENTS);
+}
+
+/*
+** Runs the game loop's ticks back to back with nothing drawn, for
+** benchmarking and soak testing the simulation on machines with no
+** display.
+*/
+static void runHeadless() {
+	if (texCachePath)
+		texCacheInit(texCachePath);
+	assetsPreload();
+
+	tankInit(&player);
+	levelInit(&level, &player, currentLevel);
+	gameStartTick = (uint32_t)SDL_AtomicGet(&tickCount);
+	state = game;
+
+	/* A replay can end the run early */
+	long ran = 0;
+	uint64_t start = SDL_GetPerformanceCounter();
+	while (ran < headlessTicks && !replayFinished()) {
+		tick();
+		ran++;
+	}
+	uint64_t end = SDL_GetPerformanceCounter();
+
+	double seconds = (double)(end - start) / SDL_GetPerformanceFrequency();
+	printf("Ran %li ticks of level %i in %.3fs\n", ran, currentLevel,
+		   seconds);
+	printf("%.0f ticks per second, %.3fus per tick\n",
+		   seconds > 0 ? ran / seconds : 0.0,
+		   ran ? seconds * 1e6 / ran : 0.0);
+
+	quitSDL();
 }
 
 int main(int argc, char **argv) {
+	parseArgs(argc, argv);
+
 	printBanner();
+
+	if (headless) {
+		initSDL(sdl_headlessSystems);
+		runHeadless();
+		return 0;
+	}
+
 	initSDL(sdl_systems);
 
+	/* Default to one frame per display refresh */
+	if (targetFps == 0) {
+		SDL_DisplayMode mode;
+		if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window),
+									  &mode) == 0 &&
+			mode.refresh_rate > 0)
+			targetFps = mode.refresh_rate;
+		else
+			targetFps = 60;
+	}
+
+	/* Uncapped, aim for 60 frames a second */
+	scaleSetBudget(1000.0 / (targetFps > 0 ? targetFps : 60), vsync);
+
 	long milisTime = SDL_GetTicks();
-	long lastTime = SDL_GetPerformanceCounter();
-	double unprocessed = 0;
-	double tickInterval = (double)SDL_GetPerformanceFrequency() / maxtps;
 
 	init();
+	paceInit(maxtps, targetFps, vsync);
+
+	if (simStart(maxtps, &level, &player, gameTick))
+		puts("DEBUG: Simulating on a thread of its own");
+
+	if (devMode)
+		devMode = hotInit();
 
+	/*
+	 * Input is read as late as possible before the ticks that use it, and
+	 * the wait for the next frame happens after presenting, so pacing adds
+	 * no delay between an input and the frame that shows it.
+	 */
 	while (running) {
-		long now = SDL_GetPerformanceCounter();
-		unprocessed += (double)(now - lastTime) / tickInterval;
-		lastTime = now;
+		profileBegin(PROF_FRAME);
 
-		while (unprocessed >= 1) {
-			ticks++;
+		handleEvents();
+
+		/* Between ticks, so nothing sees a level half swapped */
+		if (devMode)
+			hotReload();
+
+		int due = paceTicksDue();
+		for (int i = 0; i < due; i++)
 			tick();
-			unprocessed -= 1;
-		}
 
-		SDL_Delay(2);
+		/*
+		 * A menu with nothing changing is left on screen as it is. Rather
+		 * than draw it again, sleep until there's input, waking now and
+		 * then to let its ticks run in case one of them changes something.
+		 */
+		if (menuIdle()) {
+			SDL_WaitEventTimeout(NULL, UI_IDLE_WAIT_MS);
+		} else {
+			frames++;
+			render();
+
+			if (SDL_AtomicGet(&replayEnded)) {
+				simSetActive(false);
+				printf("Replay finished after %u ticks\n",
+					   (uint32_t)SDL_AtomicGet(&tickCount));
+				running = false;
+			}
 
-		frames++;
-		render();
-		handleEvents();
+			paceWait();
+		}
+
+		profileEnd(PROF_FRAME);
 
 		if (SDL_GetTicks() - milisTime > 1000) {
 			milisTime += 1000;
-			printf("DEBUG: %i ticks, approx %i fps\n", ticks, frames);
+			printf("DEBUG: %i ticks, approx %i fps",
+				   SDL_AtomicSet(&ticks, 0), frames);
+
+			/* Dynamic resolution reports here rather than at every step */
+			int percent = (int)lroundf(scaleFactor() * 100);
+			if (percent < 100)
+				printf(", scene at %i%%", percent);
+			putchar('\n');
 
 			frames = 0;
-			ticks = 0;
 		}
 	}
 
@@ -11,121 +11,487 @@
 #include <SDL2/SDL_surface.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "tank.h"
 
 extern enum GameState state;
+extern struct Menu *currentMenu;
 extern struct SDL_Renderer *renderer;
 extern TTF_Font *programFont;
 
 static const char *buttonBackgroundTexture = "res/ui/btn.png";
 static const char *buttonFocusBackgroundTexture = "res/ui/fbtn.png";
 
-void menuInit(struct Menu *menu) {
-	menu->labelCount = 0;
-	menu->buttonCount = 0;
-	menu->imageCount = 0;
+/*
+** A menu is a tree of widgets. Adding one only links it in; the next time
+** the menu is used the tree is flattened into draw order, which also hands
+** out ids. Layout runs after anything that may have moved a widget and
+** caches each one's on-screen bounds, so drawing is just drawing, and the
+** hit index only changes for buttons that actually moved.
+**
+** Mouse and keyboard events come straight from handleEvents. What the
+** mouse is over is looked up in the hit index, so an event costs the same
+** however many widgets there are. A click is a press and a release on the
+** same button; Tab and Enter move and use the same focus from the keyboard.
+**
+** Menus also keep track of whether what's on screen is still current, so
+** an idle menu needn't be drawn at all. Moving, resizing, refocusing and
+** new label text are all noticed here; a hook that changes anything else
+** about a widget's look must call widgetDirty. Widgets with onFrame hooks
+** may draw anything, so their menus are redrawn every frame.
+*/
+static void widgetInit(struct Widget *widget, enum WidgetType type) {
+	widget->type = type;
+	widget->id = 0;
+
+	widget->parent = NULL;
+	widget->firstChild = NULL;
+	widget->lastChild = NULL;
+	widget->next = NULL;
+
+	widget->bounds.x = widget->bounds.y = 0;
+	widget->bounds.w = widget->bounds.h = 0;
 }
 
-void menuDestroy(struct Menu *menu) {
-	for (int i = 0; i < menu->labelCount; i++) {
-		labelDestroy(menu->labels[i]);
+/* Where the widget wants to be, relative to its parent */
+SDL_Rect *widgetRect(struct Widget *widget) {
+	switch (widget->type) {
+	case WIDGET_LABEL:
+		return &((struct Label *)widget)->location;
+	case WIDGET_BUTTON:
+		return &((struct Button *)widget)->place;
+	case WIDGET_IMAGE:
+		return &((struct Image *)widget)->location;
+	case WIDGET_PARTIAL_IMAGE:
+		return &((struct PartialImage *)widget)->location;
+	default:
+		return NULL;
 	}
+}
+
+static bool widgetPlace(struct Widget *widget) {
+	SDL_Rect *rect = widgetRect(widget);
+	SDL_Rect *origin = &widget->parent->bounds;
+	SDL_Rect old = widget->bounds;
+
+	widget->bounds.x = origin->x + rect->x;
+	widget->bounds.y = origin->y + rect->y;
+	widget->bounds.w = rect->w;
+	widget->bounds.h = rect->h;
+
+	return old.x != widget->bounds.x || old.y != widget->bounds.y ||
+		   old.w != widget->bounds.w || old.h != widget->bounds.h;
+}
 
-	for (int j = 0; j < menu->buttonCount; j++) {
-		buttonDestroy(menu->buttons[j]);
+static void widgetDestroy(struct Widget *widget) {
+	tweenCancel(widget);
+
+	switch (widget->type) {
+	case WIDGET_LABEL:
+		labelDestroy((struct Label *)widget);
+		break;
+	case WIDGET_BUTTON:
+		buttonDestroy((struct Button *)widget);
+		break;
+	case WIDGET_IMAGE:
+		imageDestroy((struct Image *)widget);
+		break;
+	case WIDGET_PARTIAL_IMAGE:
+		partialImageDestroy((struct PartialImage *)widget);
+		break;
+	default:
+		break;
 	}
+}
 
-	for (int k = 0; k < menu->imageCount; k++) {
-		imageDestroy(menu->images[k]);
+static void widgetTick(struct Widget *widget) {
+	switch (widget->type) {
+	case WIDGET_LABEL:
+		labelTick((struct Label *)widget);
+		break;
+	case WIDGET_BUTTON:
+		buttonTick((struct Button *)widget);
+		break;
+	case WIDGET_IMAGE:
+		imageTick((struct Image *)widget);
+		break;
+	case WIDGET_PARTIAL_IMAGE:
+		partialImageTick((struct PartialImage *)widget);
+		break;
+	default:
+		break;
 	}
 }
 
-void menuTick(struct Menu *menu) {
-	for (int i = 0; i < menu->labelCount; i++) {
-		labelTick(menu->labels[i]);
+/* onFrame hooks all run before layout, so whatever they move draws in place */
+static bool widgetFrame(struct Widget *widget) {
+	switch (widget->type) {
+	case WIDGET_LABEL: {
+		struct Label *label = (struct Label *)widget;
+		if (!label->onFrame)
+			return false;
+		label->onFrame(label);
+		return true;
+	}
+	case WIDGET_BUTTON: {
+		struct Button *button = (struct Button *)widget;
+		if (!button->onFrame)
+			return false;
+		button->onFrame(button);
+		return true;
+	}
+	case WIDGET_IMAGE: {
+		struct Image *image = (struct Image *)widget;
+		if (!image->onFrame)
+			return false;
+		image->onFrame(image);
+		return true;
 	}
+	case WIDGET_PARTIAL_IMAGE: {
+		struct PartialImage *image = (struct PartialImage *)widget;
+		if (!image->onFrame)
+			return false;
+		image->onFrame(image);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
 
-	for (int j = 0; j < menu->buttonCount; j++) {
-		buttonTick(menu->buttons[j]);
+static void widgetRender(struct Widget *widget) {
+	switch (widget->type) {
+	case WIDGET_LABEL:
+		labelRender((struct Label *)widget);
+		break;
+	case WIDGET_BUTTON:
+		buttonRender((struct Button *)widget);
+		break;
+	case WIDGET_IMAGE:
+		imageRender((struct Image *)widget);
+		break;
+	case WIDGET_PARTIAL_IMAGE:
+		partialImageRender((struct PartialImage *)widget);
+		break;
+	default:
+		break;
 	}
+}
 
-	for (int k = 0; k < menu->imageCount; k++) {
-		imageTick(menu->images[k]);
+/* The topmost button under the point, if any */
+static struct Button *menuHit(struct Menu *menu, int x, int y) {
+	uint32_t ids[UI_MAX_OVERLAP];
+	int found = gridQueryPoint(&menu->hits, x, y, ids, UI_MAX_OVERLAP);
+
+	struct Widget *top = NULL;
+	for (int i = 0; i < found; i++) {
+		struct Widget *widget = menu->widgets[ids[i]];
+		if (!top || widget->id > top->id)
+			top = widget;
 	}
+
+	return (struct Button *)top;
 }
 
-void menuRender(struct Menu *menu) {
-	for (int i = 0; i < menu->labelCount; i++) {
-		labelRender(menu->labels[i]);
+static void menuFocus(struct Menu *menu, struct Button *button) {
+	if (menu->focus == button)
+		return;
+
+	if (menu->focus)
+		menu->focus->focused = false;
+
+	menu->focus = button;
+	menu->dirty = true;
+	if (!button)
+		return;
+
+	button->focused = true;
+	if (button->onFocus)
+		button->onFocus();
+}
+
+/* Keyboard focus sticks until the mouse moves, even off every button */
+static void menuHover(struct Menu *menu) {
+	struct Button *hit = menuHit(menu, menu->mouseX, menu->mouseY);
+	if (hit || !menu->focusByKey)
+		menuFocus(menu, hit);
+}
+
+static void menuFlatten(struct Menu *menu, struct Widget *widget) {
+	if (widget != &menu->root) {
+		if (menu->widgetCount == menu->widgetCapacity) {
+			menu->widgetCapacity =
+				menu->widgetCapacity ? menu->widgetCapacity * 2 : 16;
+			menu->widgets = realloc(menu->widgets, sizeof(struct Widget *) *
+													   menu->widgetCapacity);
+			if (!menu->widgets) {
+				puts("E: Out of memory while building menu");
+				exit(1);
+			}
+		}
+
+		widget->id = menu->widgetCount;
+		menu->widgets[menu->widgetCount++] = widget;
 	}
 
-	for (int j = 0; j < menu->buttonCount; j++) {
-		buttonRender(menu->buttons[j]);
+	for (struct Widget *c = widget->firstChild; c; c = c->next)
+		menuFlatten(menu, c);
+}
+
+/* Catches up with any widgets added since the menu was last used */
+static void menuRefresh(struct Menu *menu) {
+	if (!menu->treeChanged)
+		return;
+
+	menu->widgetCount = 0;
+	menuFlatten(menu, &menu->root);
+
+	gridDestroy(&menu->hits);
+	gridInit(&menu->hits);
+
+	for (uint32_t i = 0; i < menu->widgetCount; i++) {
+		struct Widget *widget = menu->widgets[i];
+		widgetPlace(widget);
+
+		if (widget->type == WIDGET_BUTTON)
+			gridInsert(&menu->hits, widget->id, &widget->bounds);
 	}
 
-	for (int k = 0; k < menu->imageCount; k++) {
-		imageRender(menu->images[k]);
+	menu->treeChanged = false;
+	menu->dirty = true;
+	menuHover(menu);
+}
+
+/* Parents come first in draw order, so one pass places everything */
+static bool menuLayout(struct Menu *menu) {
+	bool changed = false;
+
+	for (uint32_t i = 0; i < menu->widgetCount; i++) {
+		struct Widget *widget = menu->widgets[i];
+		SDL_Rect old = widget->bounds;
+
+		if (!widgetPlace(widget))
+			continue;
+
+		changed = true;
+		if (widget->type == WIDGET_BUTTON) {
+			gridRemove(&menu->hits, widget->id, &old);
+			gridInsert(&menu->hits, widget->id, &widget->bounds);
+		}
 	}
 
-	for (int l = 0; l < menu->partialImageCount; l++) {
-		partialImageRender(menu->partialImages[l]);
+	/* A button may have moved under a mouse that didn't */
+	if (changed) {
+		menu->dirty = true;
+		menuHover(menu);
 	}
+
+	return changed;
 }
 
-void menuAddLabel(struct Menu *menu, struct Label *label) {
-	menu->labelCount++;
-	if (menu->labelCount > UI_MAX_HUD_ELEMS) {
-		puts("E: Maximum UI elements exceeded; could not register label");
-		exit(1);
-	}
+void menuInit(struct Menu *menu) {
+	widgetInit(&menu->root, WIDGET_ROOT);
+
+	menu->widgetCount = 0;
+	menu->widgetCapacity = 0;
+	menu->widgets = NULL;
+	menu->treeChanged = true;
+
+	gridInit(&menu->hits);
+	getMousePosition(&menu->mouseX, &menu->mouseY);
+
+	menu->focus = NULL;
+	menu->focusByKey = false;
+	menu->pressed = NULL;
 
-	menu->labels[menu->labelCount - 1] = label;
+	menu->dirty = true;
 }
 
-void menuAddButton(struct Menu *menu, struct Button *button) {
-	menu->buttonCount++;
-	if (menu->buttonCount > UI_MAX_HUD_ELEMS) {
-		puts("E: Maximum UI elements exceeded; could not register button");
-		exit(1);
-	}
+void menuDestroy(struct Menu *menu) {
+	menuRefresh(menu);
+
+	for (uint32_t i = 0; i < menu->widgetCount; i++)
+		widgetDestroy(menu->widgets[i]);
+
+	free(menu->widgets);
+	gridDestroy(&menu->hits);
+
+	/* Leave an empty menu behind, so destroying twice is harmless */
+	widgetInit(&menu->root, WIDGET_ROOT);
+	menu->widgets = NULL;
+	menu->widgetCount = 0;
+	menu->widgetCapacity = 0;
+	menu->treeChanged = false;
+	menu->focus = NULL;
+	menu->pressed = NULL;
+}
 
-	menu->buttons[menu->buttonCount - 1] = button;
+void menuTick(struct Menu *menu) {
+	menuRefresh(menu);
+
+	for (uint32_t i = 0; i < menu->widgetCount; i++)
+		widgetTick(menu->widgets[i]);
+
+	menuLayout(menu);
 }
 
-void menuAddImage(struct Menu *menu, struct Image *image) {
-	menu->imageCount++;
-	if (menu->imageCount > UI_MAX_HUD_ELEMS) {
-		puts("E: Maximum UI elements exceeded; could not register image");
-		exit(1);
+void menuRender(struct Menu *menu) {
+	menuRefresh(menu);
+
+	bool hooked = false;
+	for (uint32_t i = 0; i < menu->widgetCount; i++)
+		hooked |= widgetFrame(menu->widgets[i]);
+
+	menuLayout(menu);
+
+	for (uint32_t i = 0; i < menu->widgetCount; i++)
+		widgetRender(menu->widgets[i]);
+
+	menu->dirty = hooked;
+}
+
+/* Whether the menu has changed since it was last drawn */
+bool menuDirty(struct Menu *menu) {
+	menuRefresh(menu);
+	return menu->dirty;
+}
+
+void menuInvalidate(struct Menu *menu) {
+	menu->dirty = true;
+}
+
+/* Next button along in draw order from the focused one, wrapping round */
+static void menuFocusStep(struct Menu *menu, int step) {
+	int count = (int)menu->widgetCount;
+	if (!count)
+		return;
+
+	int at = menu->focus ? (int)menu->focus->node.id : (step > 0 ? -1 : count);
+	for (int i = 0; i < count; i++) {
+		at = ((at + step) % count + count) % count;
+
+		if (menu->widgets[at]->type == WIDGET_BUTTON) {
+			menu->focusByKey = true;
+			menuFocus(menu, (struct Button *)menu->widgets[at]);
+			return;
+		}
 	}
+}
 
-	menu->images[menu->imageCount - 1] = image;
+static void buttonClick(struct Button *button) {
+	if (button->onClick)
+		button->onClick();
 }
 
-void menuAddPartialImage(struct Menu *menu, struct PartialImage *image) {
-	menu->partialImageCount++;
-	if (menu->imageCount > UI_MAX_HUD_ELEMS) {
-		puts("E: Maximum UI elements exceeded; could not register p_image");
-		exit(1);
+/*
+** Called for every event as it arrives. A click may tear the whole menu
+** down, so nothing touches it after one.
+*/
+void menuHandleEvent(struct Menu *menu, const SDL_Event *e) {
+	menuRefresh(menu);
+
+	switch (e->type) {
+	case SDL_MOUSEMOTION:
+		menu->mouseX = e->motion.x;
+		menu->mouseY = e->motion.y;
+		menu->focusByKey = false;
+		menuHover(menu);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+		if (e->button.button == SDL_BUTTON_LEFT)
+			menu->pressed = menuHit(menu, e->button.x, e->button.y);
+		break;
+	case SDL_MOUSEBUTTONUP: {
+		if (e->button.button != SDL_BUTTON_LEFT)
+			break;
+
+		struct Button *pressed = menu->pressed;
+		menu->pressed = NULL;
+
+		if (pressed && pressed == menuHit(menu, e->button.x, e->button.y))
+			buttonClick(pressed);
+		break;
 	}
+	case SDL_WINDOWEVENT:
+		if (e->window.event == SDL_WINDOWEVENT_EXPOSED ||
+			e->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+			menu->dirty = true;
+		break;
+	case SDL_RENDER_TARGETS_RESET: /* FALLTHROUGH */
+	case SDL_RENDER_DEVICE_RESET:
+		menu->dirty = true;
+		break;
+	case SDL_KEYDOWN:
+		if (e->key.keysym.scancode == SDL_SCANCODE_TAB)
+			menuFocusStep(menu, (e->key.keysym.mod & KMOD_SHIFT) ? -1 : 1);
+		else if ((e->key.keysym.scancode == SDL_SCANCODE_RETURN ||
+				  e->key.keysym.scancode == SDL_SCANCODE_KP_ENTER) &&
+				 !e->key.repeat && menu->focus)
+			buttonClick(menu->focus);
+		break;
+	default:
+		break;
+	}
+}
+
+void menuAttach(struct Menu *menu, struct Widget *parent,
+				struct Widget *child) {
+	child->parent = parent;
+	child->next = NULL;
+
+	if (parent->lastChild)
+		parent->lastChild->next = child;
+	else
+		parent->firstChild = child;
+	parent->lastChild = child;
+
+	menu->treeChanged = true;
+}
+
+/* For hooks that change how a widget looks without moving it */
+void widgetDirty(struct Widget *widget) {
+	while (widget->parent)
+		widget = widget->parent;
+
+	/* Only a menu's root has no parent and is a root */
+	if (widget->type == WIDGET_ROOT)
+		menuInvalidate(
+			(struct Menu *)((char *)widget - offsetof(struct Menu, root)));
+}
+
+void menuAddLabel(struct Menu *menu, struct Label *label) {
+	menuAttach(menu, &menu->root, &label->node);
+}
+
+void menuAddButton(struct Menu *menu, struct Button *button) {
+	menuAttach(menu, &menu->root, &button->node);
+}
+
+void menuAddImage(struct Menu *menu, struct Image *image) {
+	menuAttach(menu, &menu->root, &image->node);
+}
 
-	menu->partialImages[menu->partialImageCount - 1] = image;
+void menuAddPartialImage(struct Menu *menu, struct PartialImage *image) {
+	menuAttach(menu, &menu->root, &image->node);
 }
 
 void labelInit(struct Label *label, char *text, struct SDL_Color fg,
 			   struct SDL_Color bg, int x, int y, int w, int h) {
-	SDL_Surface *tSurf = TTF_RenderText_Shaded(programFont, text, fg, bg);
-	label->texture = SDL_CreateTextureFromSurface(renderer, tSurf);
-	SDL_FreeSurface(tSurf);
+	widgetInit(&label->node, WIDGET_LABEL);
 
 	label->location.x = x;
 	label->location.y = y;
 	label->location.w = w;
 	label->location.h = h;
 
-	label->text = text;
+	label->text[0] = '\0';
+	labelSetText(label, text);
+	label->size = TEXT_LARGE;
 	label->color[0] = fg;
 	label->color[1] = bg;
 
@@ -133,15 +499,41 @@ void labelInit(struct Label *label, char *text, struct SDL_Color fg,
 	label->onTick = NULL;
 }
 
+/* Cheap enough to call every frame; text longer than a label holds is cut */
+void labelSetText(struct Label *label, const char *text) {
+	char buf[UI_LABEL_MAX_TEXT];
+	snprintf(buf, sizeof(buf), "%s", text);
+
+	if (strcmp(buf, label->text) == 0)
+		return;
+
+	strcpy(label->text, buf);
+	widgetDirty(&label->node);
+}
+
 void labelDestroy(struct Label *label) {
-	SDL_DestroyTexture(label->texture);
+	/* Text lives in the shared atlas; nothing to free */
 }
 
 void labelRender(struct Label *label) {
-	if (label->onFrame)
-		label->onFrame(label);
+	/* The background box TTF_RenderText_Shaded used to give us */
+	struct SDL_Color bg = label->color[1];
+	if (bg.a) {
+		uint8_t r, g, b, a;
+		SDL_BlendMode mode;
+		SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+		SDL_GetRenderDrawBlendMode(renderer, &mode);
+
+		SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+		SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+		SDL_RenderFillRect(renderer, &label->node.bounds);
+		SDL_SetRenderDrawColor(renderer, r, g, b, a);
+		SDL_SetRenderDrawBlendMode(renderer, mode);
+	}
 
-	SDL_RenderCopy(renderer, label->texture, NULL, &label->location);
+	textDrawFit(label->size, label->text, &label->node.bounds,
+				label->color[0]);
+	batchFlush();
 }
 
 void labelTick(struct Label *label) {
@@ -152,22 +544,19 @@ void labelTick(struct Label *label) {
 void buttonInit(struct Button *button, char *text,
 				struct SDL_Color focusTextCol, struct SDL_Color unfocusTextCol,
 				int x, int y, int w, int h) {
+	widgetInit(&button->node, WIDGET_BUTTON);
+
 	SDL_Surface *tuSurf =
 		TTF_RenderText_Solid(programFont, text, unfocusTextCol);
 	SDL_Surface *tfSurf = TTF_RenderText_Solid(programFont, text, focusTextCol);
 
-	SDL_Surface *ubgSurf = loadTexture(buttonBackgroundTexture);
-	SDL_Surface *fbgSurf = loadTexture(buttonFocusBackgroundTexture);
-
-	button->focusBackTex = SDL_CreateTextureFromSurface(renderer, fbgSurf);
+	button->focusBackTex = assetAcquire(buttonFocusBackgroundTexture);
 	button->focusTextTex = SDL_CreateTextureFromSurface(renderer, tfSurf);
-	button->unfocusBackTex = SDL_CreateTextureFromSurface(renderer, ubgSurf);
+	button->unfocusBackTex = assetAcquire(buttonBackgroundTexture);
 	button->unfocusTextTex = SDL_CreateTextureFromSurface(renderer, tuSurf);
 
 	SDL_FreeSurface(tuSurf);
 	SDL_FreeSurface(tfSurf);
-	SDL_FreeSurface(ubgSurf);
-	SDL_FreeSurface(fbgSurf);
 
 	button->place.x = x;
 	button->place.y = y;
@@ -176,9 +565,6 @@ void buttonInit(struct Button *button, char *text,
 
 	button->focused = false;
 
-	button->wasFocused = false;
-	button->wasClicked = false;
-
 	button->onFrame = NULL;
 	button->onTick = NULL;
 	button->onClick = NULL;
@@ -186,52 +572,29 @@ void buttonInit(struct Button *button, char *text,
 }
 
 void buttonDestroy(struct Button *button) {
-	SDL_DestroyTexture(button->focusBackTex);
+	assetRelease(button->focusBackTex);
 	SDL_DestroyTexture(button->focusTextTex);
 
-	SDL_DestroyTexture(button->unfocusBackTex);
+	assetRelease(button->unfocusBackTex);
 	SDL_DestroyTexture(button->unfocusTextTex);
 }
 
 void buttonRender(struct Button *button) {
-	SDL_Point mouseP;
-	uint32_t but = SDL_GetMouseState(&mouseP.x, &mouseP.y);
-
-	button->focused = SDL_PointInRect(&mouseP, &button->place);
-
-	SDL_Texture *backTexture;
+	struct Asset *backTexture;
 	SDL_Texture *textTexture;
 	if (button->focused) {
 		backTexture = button->focusBackTex;
 		textTexture = button->focusTextTex;
-
-		/* Call frame-perfect hooks */
-		if (!button->wasFocused && button->onFocus) {
-			button->wasFocused = true;
-			button->onFocus();
-		}
-
-		if (but & SDL_BUTTON(SDL_BUTTON_LEFT) && button->onClick) {
-			if (!button->wasClicked)
-				button->onClick();
-			button->wasClicked = true;
-		} else {
-			button->wasClicked = false;
-		}
 	} else {
-		button->wasFocused = false;
-
 		backTexture = button->unfocusBackTex;
 		textTexture = button->unfocusTextTex;
 	}
 
-	if (button->onFrame)
-		button->onFrame(button);
-
-	SDL_RenderCopy(renderer, backTexture, NULL, &button->place);
-	SDL_RenderCopy(renderer, textTexture, NULL, &button->place);
+	SDL_RenderCopy(renderer, backTexture->texture, NULL, &button->node.bounds);
+	SDL_RenderCopy(renderer, textTexture, NULL, &button->node.bounds);
 }
 
+/* Hover and clicks arrive as events; see menuHandleEvent */
 void buttonTick(struct Button *button) {
 	if (button->onTick)
 		button->onTick(button);
@@ -239,30 +602,44 @@ void buttonTick(struct Button *button) {
 
 void imageInit(struct Image *image, char *texturePath, int x, int y, int w,
 			   int h, float rot) {
-	SDL_Surface *texSurf = loadTexture(texturePath);
-	image->imageTexture = SDL_CreateTextureFromSurface(renderer, texSurf);
-	SDL_FreeSurface(texSurf);
+	widgetInit(&image->node, WIDGET_IMAGE);
+
+	image->imageTexture = assetAcquire(texturePath);
 
 	image->location.x = x;
 	image->location.y = y;
 	image->location.w = w;
 	image->location.h = h;
 	image->rotation = rot;
+	image->alpha = 255;
 
 	image->onFrame = NULL;
 	image->onTick = NULL;
 }
 
 void imageDestroy(struct Image *image) {
-	SDL_DestroyTexture(image->imageTexture);
+	assetRelease(image->imageTexture);
 }
 
-void imageRender(struct Image *image) {
-	if (image->onFrame)
-		image->onFrame(image);
+/* Textures are shared through the asset cache, so fading one is undone */
+static void fadedCopy(SDL_Texture *texture, const SDL_Rect *src,
+					  const SDL_Rect *dst, float rotation, uint8_t alpha) {
+	if (!alpha)
+		return;
+
+	if (alpha != 255)
+		SDL_SetTextureAlphaMod(texture, alpha);
 
-	SDL_RenderCopyEx(renderer, image->imageTexture, NULL, &image->location,
-					 image->rotation, NULL, SDL_FLIP_NONE);
+	SDL_RenderCopyEx(renderer, texture, src, dst, rotation, NULL,
+					 SDL_FLIP_NONE);
+
+	if (alpha != 255)
+		SDL_SetTextureAlphaMod(texture, 255);
+}
+
+void imageRender(struct Image *image) {
+	fadedCopy(image->imageTexture->texture, NULL, &image->node.bounds,
+			  image->rotation, image->alpha);
 }
 
 void imageTick(struct Image *image) {
@@ -273,9 +650,9 @@ void imageTick(struct Image *image) {
 void partialImageInit(struct PartialImage *image, char *texturePath, int x,
 					  int y, int w, int h, int imageX, int imageY, int imageW,
 					  int imageH, float rot) {
-	SDL_Surface *texSurf = loadTexture(texturePath);
-	image->imageTexture = SDL_CreateTextureFromSurface(renderer, texSurf);
-	SDL_FreeSurface(texSurf);
+	widgetInit(&image->node, WIDGET_PARTIAL_IMAGE);
+
+	image->imageTexture = assetAcquire(texturePath);
 
 	image->location.x = x;
 	image->location.y = y;
@@ -287,21 +664,19 @@ void partialImageInit(struct PartialImage *image, char *texturePath, int x,
 	image->imagePortion.y = imageY;
 	image->imagePortion.w = imageW;
 	image->imagePortion.h = imageH;
+	image->alpha = 255;
 
 	image->onFrame = NULL;
 	image->onTick = NULL;
 }
 
 void partialImageDestroy(struct PartialImage *image) {
-	SDL_DestroyTexture(image->imageTexture);
+	assetRelease(image->imageTexture);
 }
 
 void partialImageRender(struct PartialImage *image) {
-	if (image->onFrame)
-		image->onFrame(image);
-
-	SDL_RenderCopyEx(renderer, image->imageTexture, &image->imagePortion,
-					 &image->location, image->rotation, NULL, SDL_FLIP_NONE);
+	fadedCopy(image->imageTexture->texture, &image->imagePortion,
+			  &image->node.bounds, image->rotation, image->alpha);
 }
 
 void partialImageTick(struct PartialImage *image) {
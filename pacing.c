@@ -0,0 +1,118 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Frame pacing routines
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** Ticks run on a fixed clock: real time accumulates, and each whole tick
+** interval of it becomes one tick, up to PACE_MAX_CATCHUP per frame. Any
+** more than that is dropped rather than letting a slow frame cause more
+** ticks and an even slower next frame. Once a level is playing, its ticks
+** keep their own time instead; see sim.c.
+**
+** Frames are paced one of three ways: by vsync in SDL_RenderPresent, to a
+** target rate by waiting here, or not at all. Waiting sleeps for as long
+** as the OS can be trusted to wake us up on time, then spins the rest.
+** How long SDL_Delay(1) really takes is measured as we go, so the spin is
+** no longer than this machine needs.
+*/
+static double tickInterval;
+static double frameInterval;
+static bool vsync;
+
+static uint64_t lastTime;
+static double unprocessed;
+static uint64_t nextFrame;
+
+/* Running mean and variance of SDL_Delay(1), in counter units */
+static double delayMean;
+static double delayM2;
+static long delaySamples;
+
+void paceInit(double tps, double fps, bool useVsync) {
+	double freq = (double)SDL_GetPerformanceFrequency();
+
+	tickInterval = freq / tps;
+	frameInterval = fps > 0 && !useVsync ? freq / fps : 0;
+	vsync = useVsync;
+
+	/* Assume a sloppy scheduler until we've seen otherwise */
+	delayMean = freq / 500.0;
+	delayM2 = 0;
+	delaySamples = 1;
+
+	paceReset();
+}
+
+void paceReset() {
+	lastTime = SDL_GetPerformanceCounter();
+	unprocessed = 0;
+	nextFrame = lastTime + (uint64_t)frameInterval;
+}
+
+int paceTicksDue() {
+	uint64_t now = SDL_GetPerformanceCounter();
+	unprocessed += (double)(now - lastTime) / tickInterval;
+	lastTime = now;
+
+	int due = (int)unprocessed;
+	if (due > PACE_MAX_CATCHUP) {
+		due = PACE_MAX_CATCHUP;
+		unprocessed -= floor(unprocessed);
+	} else {
+		unprocessed -= due;
+	}
+
+	return due;
+}
+
+static void measureDelay(double taken) {
+	delaySamples++;
+
+	double delta = taken - delayMean;
+	delayMean += delta / delaySamples;
+	delayM2 += delta * (taken - delayMean);
+}
+
+static void waitUntil(uint64_t deadline) {
+	for (;;) {
+		uint64_t now = SDL_GetPerformanceCounter();
+		if (now >= deadline)
+			return;
+
+		/* Only sleep if even a late wakeup lands before the deadline */
+		double spread = sqrt(delayM2 / delaySamples);
+		if ((double)(deadline - now) <= delayMean + 2 * spread)
+			break;
+
+		SDL_Delay(1);
+		measureDelay((double)(SDL_GetPerformanceCounter() - now));
+	}
+
+	while (SDL_GetPerformanceCounter() < deadline)
+		;
+}
+
+void paceWait() {
+	if (vsync || frameInterval <= 0)
+		return;
+
+	waitUntil(nextFrame);
+
+	/* After a long stall, restart the schedule rather than rush to catch up */
+	uint64_t now = SDL_GetPerformanceCounter();
+	nextFrame += (uint64_t)frameInterval;
+	if (nextFrame < now)
+		nextFrame = now + (uint64_t)frameInterval;
+}
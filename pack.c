@@ -0,0 +1,200 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Pack archive reading routines
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <SDL2/SDL.h>
+
+#include "pack.h"
+#include "tank.h"
+
+/*
+** All game data can come from one archive (see pack.h and "make pack"),
+** mapped into memory once at startup. Lookups hash the path and probe the
+** archive's own index, and files are handed out as pointers into the
+** mapping, so reading one costs no syscalls and no copies.
+**
+** The archive is looked for next to the executable, then in the working
+** directory. Without one, files are read loose, again trying next to the
+** executable first, so the game runs from anywhere either way.
+*/
+static const char *packName = "tank-game.pak";
+
+static const unsigned char *packMap = NULL;
+static size_t packSize = 0;
+static int64_t packMtime = 0;
+static const struct PackHeader *packHeader = NULL;
+static const struct PackEntry *packTable = NULL;
+
+static char *basePath = NULL;
+
+static bool packMapFile(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct PackHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const struct PackHeader *header = map;
+	uint64_t tableEnd = sizeof(struct PackHeader) +
+						(uint64_t)header->bucketCount * sizeof(struct PackEntry);
+
+	if (memcmp(header->magic, PACK_MAGIC, sizeof(header->magic)) != 0 ||
+		header->byteOrder != PACK_BYTE_ORDER ||
+		header->version != PACK_FILE_VERSION || !header->bucketCount ||
+		(header->bucketCount & (header->bucketCount - 1)) ||
+		tableEnd > (uint64_t)st.st_size) {
+		printf("W: Ignoring unusable pack \"%s\"\n", path);
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	packMap = map;
+	packSize = st.st_size;
+	packMtime = (int64_t)st.st_mtime;
+	packHeader = header;
+	packTable = (const struct PackEntry *)(header + 1);
+
+	return true;
+}
+
+bool packOpen() {
+	char *base = SDL_GetBasePath();
+	if (base) {
+		basePath = malloc(strlen(base) + 1);
+		if (basePath)
+			strcpy(basePath, base);
+		SDL_free(base);
+	}
+
+	char path[LVL_MAX_PATH];
+	if (basePath) {
+		snprintf(path, sizeof(path), "%s%s", basePath, packName);
+		if (packMapFile(path))
+			return true;
+	}
+
+	return packMapFile(packName);
+}
+
+void packClose() {
+	if (packMap)
+		munmap((void *)packMap, packSize);
+
+	free(basePath);
+
+	packMap = NULL;
+	packHeader = NULL;
+	packTable = NULL;
+	basePath = NULL;
+}
+
+bool packFind(const char *name, const void **data, size_t *size) {
+	if (!packMap)
+		return false;
+
+	size_t len = strlen(name);
+	uint64_t hash = packHash(name, len);
+	uint32_t mask = packHeader->bucketCount - 1;
+
+	uint32_t b = (uint32_t)hash & mask;
+	for (uint32_t i = 0; i <= mask; i++, b = (b + 1) & mask) {
+		const struct PackEntry *e = &packTable[b];
+		if (!e->nameLength)
+			return false;
+
+		if (e->hash != hash || e->nameLength != len ||
+			e->nameOffset + (uint64_t)len > packSize ||
+			memcmp(packMap + e->nameOffset, name, len) != 0)
+			continue;
+
+		/* Written so a corrupt index can't wrap the sum past the check */
+		if (e->size > packSize || e->offset > packSize - e->size)
+			return false;
+
+		*data = packMap + e->offset;
+		*size = e->size;
+		return true;
+	}
+
+	return false;
+}
+
+/* Fills in where a loose file would be; false if there is none */
+bool packLoosePath(const char *name, char *buf, size_t len) {
+	struct stat st;
+
+	if (basePath) {
+		snprintf(buf, len, "%s%s", basePath, name);
+		if (stat(buf, &st) == 0)
+			return true;
+	}
+
+	snprintf(buf, len, "%s", name);
+	return stat(buf, &st) == 0;
+}
+
+/*
+** Size and modification time of whatever packOpenRW would read; packed
+** files all share the archive's time.
+*/
+bool packStat(const char *name, uint64_t *size, int64_t *mtime) {
+	const void *data;
+	size_t packed;
+	if (packFind(name, &data, &packed)) {
+		*size = packed;
+		*mtime = packMtime;
+		return true;
+	}
+
+	char path[LVL_MAX_PATH];
+	struct stat st;
+	if (!packLoosePath(name, path, sizeof(path)) || stat(path, &st) < 0)
+		return false;
+
+	*size = (uint64_t)st.st_size;
+	*mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+/*
+** Either a view straight onto the archive, or the loose file if it isn't
+** packed. Close it with SDL_RWclose as usual.
+*/
+struct SDL_RWops *packOpenRW(const char *name) {
+	const void *data;
+	size_t size;
+	if (packFind(name, &data, &size))
+		return SDL_RWFromConstMem(data, (int)size);
+
+	char path[LVL_MAX_PATH];
+	if (!packLoosePath(name, path, sizeof(path)))
+		return NULL;
+
+	return SDL_RWFromFile(path, "rb");
+}
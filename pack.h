@@ -0,0 +1,61 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Pack archive format, shared by the game and tools/mkpack
+ */
+
+#ifndef PACK_H_INCLUDED
+#define PACK_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+** A pack is a PackHeader, then an open addressed hash table of
+** bucketCount PackEntries, then every entry's name, then every entry's
+** data. Names are the paths the game asks for ("res/tank.png"), stored
+** without terminators. Data starts PACK_ALIGN aligned. Empty buckets have
+** a nameLength of zero.
+**
+** Everything is in host byte order, like compiled levels; a pack is built
+** alongside the binary that reads it.
+*/
+#define PACK_FILE_VERSION 1
+#define PACK_ALIGN 16
+#define PACK_MAGIC "TNKP"
+#define PACK_BYTE_ORDER 0x01020304
+
+struct PackHeader {
+	char magic[4];
+	uint32_t byteOrder;
+	uint32_t version;
+
+	uint32_t entryCount;
+	uint32_t bucketCount; /* Always a power of two */
+	uint32_t reserved;
+};
+
+struct PackEntry {
+	uint64_t hash;
+
+	uint32_t nameOffset;
+	uint32_t nameLength;
+
+	uint64_t offset;
+	uint64_t size;
+};
+
+/* 64 bit FNV-1a */
+static inline uint64_t packHash(const char *name, size_t len) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t)name[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+#endif
@@ -26,42 +26,92 @@ void tankInit(struct Player *player) {
 	player->y = 100;
 	player->heading = 0.0;
 
-	player->texSurface = loadTexture(tankTexture);
-	player->texture =
-		SDL_CreateTextureFromSurface(renderer, player->texSurface);
+	player->prevX = player->x;
+	player->prevY = player->y;
+	player->prevHeading = player->heading;
+
+	player->texture = assetAcquire(tankTexture);
 }
 
 void tankDestroy(struct Player *player) {
-	SDL_DestroyTexture(player->texture);
-	SDL_FreeSurface(player->texSurface);
+	assetRelease(player->texture);
+}
+
+/* The middle of the tank, part way from the last tick to this one */
+void tankFocus(struct Player *player, double alpha, float *x, float *y) {
+	*x = (float)(player->prevX + (player->x - player->prevX) * alpha) +
+		 tankSize / 2.0f;
+	*y = (float)(player->prevY + (player->y - player->prevY) * alpha) +
+		 tankSize / 2.0f;
+}
+
+/* Drawn part way from the last tick's position to this one's */
+void tankRender(struct Player *player, double alpha, const SDL_Rect *camera) {
+	struct SDL_FRect place = {
+		(float)(player->prevX + (player->x - player->prevX) * alpha) -
+			camera->x,
+		(float)(player->prevY + (player->y - player->prevY) * alpha) -
+			camera->y,
+		tankSize,
+		tankSize,
+	};
+	double heading =
+		player->prevHeading + (player->heading - player->prevHeading) * alpha;
+
+	if (softEnabled()) {
+		softDraw(player->texture, &place, heading);
+		return;
+	}
+
+	SDL_RenderCopyExF(renderer, player->texture->texture, NULL, &place,
+					  heading, NULL, SDL_FLIP_NONE);
 }
 
-void tankRender(struct Player *player) {
-	struct SDL_Rect place = {
-		player->x,
-		player->y,
+/*
+** Each axis is moved and checked on its own, so running into a wall at an
+** angle slides along it instead of stopping dead.
+*/
+static void tankMove(struct Player *player, struct Level *level, int dx,
+					 int dy) {
+	struct SDL_Rect next = {
+		player->x + dx,
+		player->y + dy,
 		tankSize,
 		tankSize,
 	};
 
-	SDL_RenderCopyEx(renderer, player->texture, NULL, &place, player->heading,
-					 NULL, SDL_FLIP_NONE);
+	if (level && levelCollides(level, &next))
+		return;
+
+	player->x = next.x;
+	player->y = next.y;
 }
 
-void tankTick(struct Player *player, long milisTime) {
-	if (isKeyDown((uint8_t)SDLK_UP)) {
-		player->y--;
+void tankTick(struct Player *player, struct Level *level, long milisTime) {
+	int dx = 0, dy = 0;
+
+	player->prevX = player->x;
+	player->prevY = player->y;
+	player->prevHeading = player->heading;
+
+	if (isKeyDown(SDL_SCANCODE_UP)) {
+		dy--;
 	}
 
-	if (isKeyDown((uint8_t)SDLK_DOWN)) {
-		player->y++;
+	if (isKeyDown(SDL_SCANCODE_DOWN)) {
+		dy++;
 	}
 
-	if (isKeyDown((uint8_t)SDLK_RIGHT)) {
-		player->x++;
+	if (isKeyDown(SDL_SCANCODE_RIGHT)) {
+		dx++;
 	}
 
-	if (isKeyDown((uint8_t)SDLK_LEFT)) {
-		player->x--;
+	if (isKeyDown(SDL_SCANCODE_LEFT)) {
+		dx--;
 	}
+
+	if (dx)
+		tankMove(player, level, dx, 0);
+	if (dy)
+		tankMove(player, level, 0, dy);
 }
@@ -0,0 +1,129 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Frame phase profiling routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** Each phase of the main loop is timed between profileBegin and
+** profileEnd, and every timing goes into that phase's ring of the most
+** recent PROF_HISTORY samples. Statistics are only worked out from the
+** rings when something asks for them, so timing itself is just two
+** counter reads and a store.
+**
+** A phase may not be nested inside itself.
+**
+** Game ticks are timed on the simulation thread (see sim.c) and read from
+** the main one without locking, so statistics may catch a sample half way
+** through being stored. For an overlay, that's fine.
+*/
+struct PhaseHistory {
+	uint64_t started;
+
+	float samples[PROF_HISTORY];
+	int next;
+	int count;
+};
+
+static struct PhaseHistory phases[PROF_PHASE_COUNT];
+static double msPerCount = 0;
+
+static const char *phaseNames[PROF_PHASE_COUNT] = {
+	[PROF_FRAME] = "frame",
+	[PROF_EVENTS] = "events",
+	[PROF_TICK] = "tick",
+	[PROF_MENU_TICK] = " menuTick",
+	[PROF_LEVEL_TICK] = " levelTick",
+	[PROF_TANK_TICK] = " tankTick",
+	[PROF_RENDER] = "render",
+	[PROF_MENU_RENDER] = " menuRender",
+	[PROF_LEVEL_RENDER] = " levelRender",
+	[PROF_TANK_RENDER] = " tankRender",
+	[PROF_HUD_RENDER] = " HUDRender",
+	[PROF_PRESENT] = " present",
+};
+
+/* Same names, minus the indentation used by the overlay */
+static const char *traceName(enum ProfilePhase phase) {
+	const char *name = phaseNames[phase];
+	while (*name == ' ')
+		name++;
+
+	return name;
+}
+
+void profileBegin(enum ProfilePhase phase) {
+	traceBegin(traceName(phase));
+	phases[phase].started = SDL_GetPerformanceCounter();
+}
+
+void profileEnd(enum ProfilePhase phase) {
+	uint64_t now = SDL_GetPerformanceCounter();
+	struct PhaseHistory *h = &phases[phase];
+
+	traceEnd(traceName(phase));
+
+	if (msPerCount == 0)
+		msPerCount = 1000.0 / SDL_GetPerformanceFrequency();
+
+	h->samples[h->next] = (float)((now - h->started) * msPerCount);
+	h->next = (h->next + 1) % PROF_HISTORY;
+	if (h->count < PROF_HISTORY)
+		h->count++;
+}
+
+const char *profileName(enum ProfilePhase phase) {
+	return phaseNames[phase];
+}
+
+static int compareFloat(const void *a, const void *b) {
+	float fa = *(const float *)a;
+	float fb = *(const float *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+void profileStats(enum ProfilePhase phase, struct ProfileStats *out) {
+	struct PhaseHistory *h = &phases[phase];
+	memset(out, 0, sizeof(*out));
+
+	if (!h->count)
+		return;
+
+	float sorted[PROF_HISTORY];
+	memcpy(sorted, h->samples, sizeof(float) * h->count);
+	qsort(sorted, h->count, sizeof(float), compareFloat);
+
+	double total = 0;
+	for (int i = 0; i < h->count; i++)
+		total += sorted[i];
+
+	out->min = sorted[0];
+	out->max = sorted[h->count - 1];
+	out->avg = (float)(total / h->count);
+	out->p99 = sorted[(h->count * 99) / 100];
+	out->samples = h->count;
+}
+
+/* Copies out the phase's history, oldest first */
+int profileHistory(enum ProfilePhase phase, float *out, int max) {
+	struct PhaseHistory *h = &phases[phase];
+	int n = h->count < max ? h->count : max;
+	int start = (h->next - n + PROF_HISTORY) % PROF_HISTORY;
+
+	for (int i = 0; i < n; i++)
+		out[i] = h->samples[(start + i) % PROF_HISTORY];
+
+	return n;
+}
@@ -0,0 +1,184 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Input recording and replay routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+extern SDL_atomic_t tickCount;
+
+/*
+** A replay is a ReplayHeader followed by ReplayRecords in tick order.
+** Each record is an input that reached the input handler, stamped with
+** the number of game ticks that had run when it arrived. Playing one back
+** hands each record to the input handler just before the tick after that
+** count, which is exactly when the original input was first visible to
+** the simulation.
+**
+** Everything is in host byte order; replays are a profiling aid, not
+** something to share between machines.
+*/
+static const char rpl_magic[4] = {'T', 'N', 'K', 'R'};
+
+static FILE *recordFile = NULL;
+static uint32_t baseTick = 0;
+
+static struct ReplayRecord *records = NULL;
+static uint32_t recordCount = 0;
+static uint32_t nextRecord = 0;
+static bool playing = false;
+static bool finished = false;
+
+static void replayWrite(uint8_t type, uint16_t code, bool down, int x, int y) {
+	struct ReplayRecord rec = {
+		.tick = (uint32_t)SDL_AtomicGet(&tickCount) - baseTick,
+		.type = type,
+		.down = down,
+		.code = code,
+		.x = (int16_t)x,
+		.y = (int16_t)y,
+	};
+
+	if (fwrite(&rec, sizeof(rec), 1, recordFile) != 1) {
+		puts("W: Failed writing replay; recording stopped");
+		fclose(recordFile);
+		recordFile = NULL;
+	}
+}
+
+bool replayRecordStart(const char *path, int level, double tps) {
+	recordFile = fopen(path, "wb");
+	if (!recordFile)
+		return false;
+
+	struct ReplayHeader header;
+	memcpy(header.magic, rpl_magic, sizeof(rpl_magic));
+	header.version = RPL_FILE_VERSION;
+	header.level = level;
+	header.tps = tps;
+
+	if (fwrite(&header, sizeof(header), 1, recordFile) != 1) {
+		fclose(recordFile);
+		recordFile = NULL;
+		return false;
+	}
+
+	baseTick = (uint32_t)SDL_AtomicGet(&tickCount);
+
+	/* Anything the player does from here on depends on where they start */
+	int x, y;
+	getMousePosition(&x, &y);
+	replayWrite(RPL_MOUSEMOVE, 0, false, x, y);
+
+	return true;
+}
+
+void replayCapture(uint8_t type, uint16_t code, bool down, int x, int y) {
+	if (recordFile)
+		replayWrite(type, code, down, x, y);
+}
+
+bool replayPlayStart(const char *path, int *level, double *tps) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+
+	struct ReplayHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+		memcmp(header.magic, rpl_magic, sizeof(rpl_magic)) != 0 ||
+		header.version != RPL_FILE_VERSION) {
+		fclose(fp);
+		return false;
+	}
+
+	uint32_t capacity = 256;
+	records = malloc(sizeof(struct ReplayRecord) * capacity);
+
+	while (records &&
+		   fread(&records[recordCount], sizeof(struct ReplayRecord), 1, fp) ==
+			   1) {
+		if (++recordCount == capacity) {
+			capacity *= 2;
+			records = realloc(records, sizeof(struct ReplayRecord) * capacity);
+		}
+	}
+
+	fclose(fp);
+	if (!records) {
+		puts("E: Out of memory while loading replay");
+		exit(1);
+	}
+
+	*level = header.level;
+	*tps = header.tps;
+
+	baseTick = (uint32_t)SDL_AtomicGet(&tickCount);
+	nextRecord = 0;
+	playing = true;
+	finished = false;
+
+	return true;
+}
+
+bool replayPlaying() {
+	return playing;
+}
+
+bool replayFinished() {
+	return finished;
+}
+
+/* Feeds in everything that arrived after the ticks run so far */
+void replayFeed() {
+	if (!playing || finished)
+		return;
+
+	uint32_t now = (uint32_t)SDL_AtomicGet(&tickCount) - baseTick;
+
+	while (nextRecord < recordCount && records[nextRecord].tick <= now) {
+		struct ReplayRecord *rec = &records[nextRecord++];
+
+		switch (rec->type) {
+		case RPL_KEY:
+			updateKeys(rec->code, rec->down);
+			break;
+		case RPL_MOUSEBUTTON:
+			updateMice((uint8_t)rec->code, rec->down, rec->x, rec->y);
+			break;
+		case RPL_MOUSEMOVE:
+			updateMouse(rec->x, rec->y);
+			break;
+		case RPL_END:
+			finished = true;
+			return;
+		}
+	}
+
+	/* A replay cut short (crash, kill) just ends at its last input */
+	if (nextRecord == recordCount)
+		finished = true;
+}
+
+void replayStop() {
+	if (recordFile) {
+		replayWrite(RPL_END, 0, false, 0, 0);
+		fclose(recordFile);
+		recordFile = NULL;
+	}
+
+	free(records);
+	records = NULL;
+	recordCount = 0;
+	playing = false;
+}
@@ -0,0 +1,173 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Dynamic resolution routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** Everything is laid out in one fixed logical size, which
+** SDL_RenderSetLogicalSize maps onto the window, so levels, menus and the
+** mouse never see the real resolution.
+**
+** The scene (level and tank) can be drawn at less than that. It goes into
+** the top left corner of an offscreen target through SDL_RenderSetScale,
+** and that corner is then stretched over the screen. Menus and the HUD
+** are drawn afterwards at full resolution. At full scale the offscreen
+** step is skipped entirely.
+**
+** The scale follows how long frames take to draw. Every scaleWindow frames
+** the average is checked against the frame budget. Well over it, the
+** scale drops; well under it, the scale creeps back up, more slowly than
+** it fell. The gap between the two thresholds keeps it from flickering
+** back and forth.
+*/
+static const int scaleWindow = 30;
+static const float scaleHigh = 0.9f;
+static const float scaleLow = 0.6f;
+static const int scaleMin = 50;
+static const int scaleDown = 10;
+static const int scaleUp = 5;
+
+static int logicalW, logicalH;
+static bool dynamic = false;
+static bool vsync = false;
+static float budget = 1000.0f / 60.0f;
+
+/* Percent of full resolution the scene is drawn at */
+static int scale = 100;
+static int framesSince = 0;
+
+static struct SDL_Texture *sceneTarget = NULL;
+static bool drawingOffscreen = false;
+
+void scaleInit(int w, int h, bool useDynamic) {
+	logicalW = w;
+	logicalH = h;
+
+	SDL_RenderSetLogicalSize(renderer, w, h);
+
+	/* The software scene renderer scales itself, so needs no target */
+	if (!useDynamic || softEnabled()) {
+		dynamic = useDynamic;
+		return;
+	}
+
+	if (!SDL_RenderTargetSupported(renderer)) {
+		puts("W: Renderer can't draw offscreen; resolution will not scale");
+		return;
+	}
+
+	sceneTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+									SDL_TEXTUREACCESS_TARGET, w, h);
+	if (!sceneTarget) {
+		printf("W: Could not create scene target; resolution will not "
+			   "scale\nError message: %s\n",
+			   SDL_GetError());
+		return;
+	}
+
+	SDL_SetTextureBlendMode(sceneTarget, SDL_BLENDMODE_NONE);
+	SDL_SetTextureScaleMode(sceneTarget, SDL_ScaleModeLinear);
+	dynamic = true;
+}
+
+void scaleDestroy() {
+	if (sceneTarget)
+		SDL_DestroyTexture(sceneTarget);
+
+	sceneTarget = NULL;
+	dynamic = false;
+}
+
+/* Frames should take no longer than this, in milliseconds */
+void scaleSetBudget(double ms, bool useVsync) {
+	budget = (float)ms;
+	vsync = useVsync;
+}
+
+/* Headless runs never set a logical size, so have only the real one */
+void scaleLogicalSize(int *w, int *h) {
+	if (!logicalW) {
+		SDL_GetRendererOutputSize(renderer, w, h);
+		return;
+	}
+
+	*w = logicalW;
+	*h = logicalH;
+}
+
+float scaleFactor() {
+	return scale / 100.0f;
+}
+
+/*
+** Called once for each frame that draws the scene. With vsync, presenting
+** waits for the display however quick the frame was, so that wait is left
+** out of the measurement.
+*/
+void scaleUpdate() {
+	if (!dynamic || ++framesSince < scaleWindow)
+		return;
+
+	float render[PROF_HISTORY], present[PROF_HISTORY];
+	int n = profileHistory(PROF_RENDER, render, scaleWindow);
+	int p = profileHistory(PROF_PRESENT, present, scaleWindow);
+	if (!n)
+		return;
+
+	float total = 0;
+	for (int i = 0; i < n; i++)
+		total += render[i] - (vsync && i < p ? present[i] : 0);
+
+	float avg = total / n;
+
+	if (avg > budget * scaleHigh)
+		scale = SDL_max(scale - scaleDown, scaleMin);
+	else if (avg < budget * scaleLow)
+		scale = SDL_min(scale + scaleUp, 100);
+
+	framesSince = 0;
+}
+
+void scaleBegin() {
+	if (softEnabled()) {
+		softBegin(scaleFactor());
+		return;
+	}
+
+	drawingOffscreen = sceneTarget && scale < 100;
+	if (!drawingOffscreen)
+		return;
+
+	SDL_SetRenderTarget(renderer, sceneTarget);
+	SDL_RenderSetScale(renderer, scaleFactor(), scaleFactor());
+	SDL_RenderClear(renderer);
+}
+
+void scaleEnd() {
+	if (softEnabled()) {
+		softEnd();
+		return;
+	}
+
+	if (!drawingOffscreen)
+		return;
+
+	SDL_SetRenderTarget(renderer, NULL);
+
+	SDL_Rect drawn = {0, 0, logicalW * scale / 100, logicalH * scale / 100};
+	SDL_RenderCopy(renderer, sceneTarget, &drawn, NULL);
+	drawingOffscreen = false;
+}
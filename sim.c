@@ -0,0 +1,232 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Simulation thread routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+extern SDL_atomic_t tickCount;
+
+/*
+** While a level is being played, its ticks run on a thread of their own
+** at a fixed rate, so a slow frame never holds up the simulation and a
+** slow tick never holds up drawing. Events are still pumped on the main
+** thread, and reach the simulation through the input handler.
+**
+** After every tick the simulation copies what drawing needs (the player,
+** entities and nodes) into a WorldSnapshot and publishes it through a
+** triple buffer: it always has a buffer of its own to write, the main
+** thread always has one to read, and the third holds the newest finished
+** one. Handing buffers over is a single atomic exchange either side, so
+** neither ever waits on the other.
+**
+** Anything that changes the level's structure from the main thread, like
+** finishing a load or hot reloading, does so holding simLock. Each tick
+** runs holding it too, so a tick never sees a level half swapped. Whoever
+** holds the lock may publish.
+**
+** Without a thread (it couldn't be made, or we're headless) main ticks the
+** game itself and publishes the same way.
+*/
+#define SNAP_INDEX 3
+#define SNAP_FRESH 4
+
+static struct WorldSnapshot snapshots[3];
+static SDL_atomic_t middle;
+static int back = 0;
+static int front = 1;
+
+static struct Level *world = NULL;
+static struct Player *worldPlayer = NULL;
+static void (*step)() = NULL;
+
+static struct SDL_Thread *thread = NULL;
+static struct SDL_mutex *lock = NULL;
+static struct SDL_cond *wake = NULL;
+static bool active = false;
+static bool quitting = false;
+
+static uint64_t tickInterval;
+
+/* Sleeps off most of the wait, then spins the last moment */
+static void simWaitUntil(uint64_t deadline) {
+	uint64_t msCount = SDL_GetPerformanceFrequency() / 1000;
+
+	for (;;) {
+		uint64_t now = SDL_GetPerformanceCounter();
+		if (now >= deadline)
+			return;
+
+		if (deadline - now > 2 * msCount)
+			SDL_Delay(1);
+	}
+}
+
+static int simWorker(void *data) {
+	traceThreadName("simulation");
+
+	uint64_t next = SDL_GetPerformanceCounter();
+
+	SDL_LockMutex(lock);
+	while (!quitting) {
+		if (!active) {
+			SDL_CondWait(wake, lock);
+			next = SDL_GetPerformanceCounter();
+			continue;
+		}
+
+		SDL_UnlockMutex(lock);
+		simWaitUntil(next);
+		SDL_LockMutex(lock);
+
+		/* Stopped or paused while we slept */
+		if (!active || quitting)
+			continue;
+
+		step();
+		simPublish();
+
+		/* Too far behind to catch up; start counting again from now */
+		uint64_t now = SDL_GetPerformanceCounter();
+		next += tickInterval;
+		if (now > next + PACE_MAX_CATCHUP * tickInterval)
+			next = now;
+	}
+	SDL_UnlockMutex(lock);
+
+	return 0;
+}
+
+/*
+** Sets up snapshots of this level and player, and starts a thread to run
+** tick at tps; false if the caller must tick the game itself.
+*/
+bool simStart(double tps, struct Level *level, struct Player *player,
+			  void (*tick)()) {
+	world = level;
+	worldPlayer = player;
+	step = tick;
+
+	tickInterval = (uint64_t)(SDL_GetPerformanceFrequency() / tps);
+	SDL_AtomicSet(&middle, 2);
+
+	lock = SDL_CreateMutex();
+	wake = SDL_CreateCond();
+	if (!lock || !wake) {
+		printf("W: Could not set up simulation thread; ticking on the main "
+			   "thread\nError message: %s\n",
+			   SDL_GetError());
+		return false;
+	}
+
+	/* One core can only take turns, so a thread gains nothing */
+	if (SDL_GetCPUCount() < 2)
+		return false;
+
+	thread = SDL_CreateThread(simWorker, "simulation", NULL);
+	if (!thread) {
+		printf("W: Could not start simulation thread; ticking on the main "
+			   "thread\nError message: %s\n",
+			   SDL_GetError());
+		return false;
+	}
+
+	return true;
+}
+
+void simStop() {
+	if (thread) {
+		SDL_LockMutex(lock);
+		quitting = true;
+		SDL_CondSignal(wake);
+		SDL_UnlockMutex(lock);
+
+		SDL_WaitThread(thread, NULL);
+	}
+
+	if (wake)
+		SDL_DestroyCond(wake);
+	if (lock)
+		SDL_DestroyMutex(lock);
+
+	for (int i = 0; i < 3; i++) {
+		free(snapshots[i].statics);
+		free(snapshots[i].dynamics);
+		free(snapshots[i].nodes);
+	}
+	memset(snapshots, 0, sizeof(snapshots));
+
+	thread = NULL;
+	wake = NULL;
+	lock = NULL;
+	world = NULL;
+	active = false;
+	quitting = false;
+}
+
+bool simThreaded() {
+	return thread != NULL;
+}
+
+/* Once pausing returns, no tick is running and none will start */
+void simSetActive(bool run) {
+	simLock();
+	active = run;
+	if (wake)
+		SDL_CondSignal(wake);
+	simUnlock();
+}
+
+void simLock() {
+	if (lock)
+		SDL_LockMutex(lock);
+}
+
+void simUnlock() {
+	if (lock)
+		SDL_UnlockMutex(lock);
+}
+
+/* Only while holding simLock, or from the tick itself */
+void simPublish() {
+	if (!world)
+		return;
+
+	struct WorldSnapshot *snap = &snapshots[back];
+	levelSnapshot(world, snap);
+	snap->player = *worldPlayer;
+	snap->tick = (uint32_t)SDL_AtomicGet(&tickCount);
+	snap->published = SDL_GetPerformanceCounter();
+
+	SDL_MemoryBarrierRelease();
+	back = SDL_AtomicSet(&middle, back | SNAP_FRESH) & SNAP_INDEX;
+}
+
+/* The newest snapshot published; main thread only */
+struct WorldSnapshot *simLatest() {
+	if (SDL_AtomicGet(&middle) & SNAP_FRESH) {
+		front = SDL_AtomicSet(&middle, front) & SNAP_INDEX;
+		SDL_MemoryBarrierAcquire();
+	}
+
+	return &snapshots[front];
+}
+
+/* How far we are from a snapshot towards the next, for interpolation */
+double simAlpha(const struct WorldSnapshot *snap) {
+	double since = (double)(SDL_GetPerformanceCounter() - snap->published);
+	double alpha = since / tickInterval;
+
+	return alpha < 1.0 ? alpha : 1.0;
+}
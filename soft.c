@@ -0,0 +1,585 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Software scene rendering routines
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOFT_AVX2
+#define SOFT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** With no GPU, SDL's own software renderer is very slow at the rotated,
+** scaled copies the level is made of. Instead, when the renderer turns
+** out to be a software one (or -s asks for it), the scene is drawn here
+** straight into a streaming texture, which is then copied to the screen
+** in one go. Menus, text and the HUD still go through SDL as normal.
+**
+** Every asset keeps its pixels in memory as well, and is prepared once
+** for each size and quarter turn it is drawn at. Walls, and anything else
+** turned by a multiple of 90 degrees, are then plain rows blended with
+** SSE2, or AVX2 where the CPU has it. Anything at another angle (the
+** tank) is sampled a few pixels at a time through the inverse rotation.
+**
+** Blending is straight alpha over an opaque frame, as SDL does it. When
+** the resolution is scaled down, everything is drawn scaled into the top
+** left of the frame and only that part is stretched over the screen.
+*/
+struct Canvas {
+	uint32_t *pixels;
+	int pitch; /* In pixels, not bytes */
+};
+
+static bool enabled = false;
+
+static int frameW, frameH;
+static int activeW, activeH;
+static float scale = 1.0f;
+static float bakedScale = 0.0f;
+static struct SDL_Texture *stream = NULL;
+
+static struct Canvas frame;
+static struct Canvas baked;
+static struct Canvas *target = &frame;
+static uint32_t *bakedPixels = NULL;
+
+static void (*blendRow)(uint32_t *dst, const uint32_t *src, int n);
+static void (*rotateRow)(uint32_t *dst, int n, const struct SoftSprite *sprite,
+						 float u, float v, float du, float dv);
+
+/* x / 255, rounded, for x up to 255 * 255 */
+static inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t blendPixel(uint32_t d, uint32_t s) {
+	uint32_t a = s >> 24;
+	if (a == 255)
+		return s;
+	if (a == 0)
+		return d;
+
+	uint32_t r = div255(((s >> 16) & 0xFF) * a + ((d >> 16) & 0xFF) * (255 - a));
+	uint32_t g = div255(((s >> 8) & 0xFF) * a + ((d >> 8) & 0xFF) * (255 - a));
+	uint32_t b = div255((s & 0xFF) * a + (d & 0xFF) * (255 - a));
+
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+static void blendRowScalar(uint32_t *dst, const uint32_t *src, int n) {
+	for (int i = 0; i < n; i++)
+		dst[i] = blendPixel(dst[i], src[i]);
+}
+
+static void sampleScalar(uint32_t *dst, int n, const struct SoftSprite *sprite,
+						 float u, float v, float du, float dv) {
+	for (int i = 0; i < n; i++, u += du, v += dv) {
+		if (u < 0 || v < 0 || u >= sprite->w || v >= sprite->h)
+			continue;
+
+		dst[i] = blendPixel(dst[i], sprite->pixels[(int)v * sprite->w + (int)u]);
+	}
+}
+
+#ifdef SOFT_SSE2
+/* Widen to 16 bits a channel, blend, and narrow again */
+static inline __m128i blendHalf128(__m128i s, __m128i d) {
+	__m128i a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia));
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static inline __m128i blend4(__m128i s, __m128i d) {
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i lo = blendHalf128(_mm_unpacklo_epi8(s, zero),
+							  _mm_unpacklo_epi8(d, zero));
+	__m128i hi = blendHalf128(_mm_unpackhi_epi8(s, zero),
+							  _mm_unpackhi_epi8(d, zero));
+
+	return _mm_or_si128(_mm_packus_epi16(lo, hi),
+						_mm_set1_epi32((int)0xFF000000));
+}
+
+static void blendRowSse2(uint32_t *dst, const uint32_t *src, int n) {
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+		/* Runs of fully opaque or fully clear pixels are common */
+		int opaque = _mm_movemask_epi8(
+			_mm_cmpeq_epi32(_mm_and_si128(s, alpha), alpha));
+		if (opaque == 0xFFFF) {
+			_mm_storeu_si128((__m128i *)(dst + i), s);
+			continue;
+		}
+
+		int clear = _mm_movemask_epi8(
+			_mm_cmpeq_epi32(_mm_and_si128(s, alpha), _mm_setzero_si128()));
+		if (clear == 0xFFFF)
+			continue;
+
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		_mm_storeu_si128((__m128i *)(dst + i), blend4(s, d));
+	}
+
+	blendRowScalar(dst + i, src + i, n - i);
+}
+
+static void sampleSse2(uint32_t *dst, int n, const struct SoftSprite *sprite,
+					   float u, float v, float du, float dv) {
+	const __m128 steps = _mm_set_ps(3, 2, 1, 0);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 w = _mm_set1_ps((float)sprite->w);
+	const __m128 h = _mm_set1_ps((float)sprite->h);
+
+	__m128 us = _mm_add_ps(_mm_set1_ps(u), _mm_mul_ps(steps, _mm_set1_ps(du)));
+	__m128 vs = _mm_add_ps(_mm_set1_ps(v), _mm_mul_ps(steps, _mm_set1_ps(dv)));
+	__m128 du4 = _mm_set1_ps(du * 4);
+	__m128 dv4 = _mm_set1_ps(dv * 4);
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 inside = _mm_and_ps(
+			_mm_and_ps(_mm_cmpge_ps(us, zero), _mm_cmplt_ps(us, w)),
+			_mm_and_ps(_mm_cmpge_ps(vs, zero), _mm_cmplt_ps(vs, h)));
+		int mask = _mm_movemask_ps(inside);
+
+		if (mask) {
+			/* No gather before AVX2, so fetch the four texels by hand */
+			int32_t rows[4], cols[4];
+			_mm_storeu_si128((__m128i *)rows, _mm_cvttps_epi32(vs));
+			_mm_storeu_si128((__m128i *)cols, _mm_cvttps_epi32(us));
+
+			uint32_t texels[4];
+			for (int k = 0; k < 4; k++)
+				texels[k] = (mask >> k) & 1
+								? sprite->pixels[rows[k] * sprite->w + cols[k]]
+								: 0;
+
+			__m128i s = _mm_loadu_si128((const __m128i *)texels);
+			__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+			_mm_storeu_si128((__m128i *)(dst + i), blend4(s, d));
+		}
+
+		us = _mm_add_ps(us, du4);
+		vs = _mm_add_ps(vs, dv4);
+	}
+
+	sampleScalar(dst + i, n - i, sprite, u + du * i, v + dv * i, du, dv);
+}
+#endif
+
+#ifdef SOFT_AVX2
+static SOFT_TARGET_AVX2 inline __m256i blendHalf256(__m256i s, __m256i d) {
+	__m256i a = _mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+	__m256i x =
+		_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia));
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/* Unpacking and packing both work per 128-bit lane, so the order holds */
+static SOFT_TARGET_AVX2 inline __m256i blend8(__m256i s, __m256i d) {
+	const __m256i zero = _mm256_setzero_si256();
+
+	__m256i lo = blendHalf256(_mm256_unpacklo_epi8(s, zero),
+							  _mm256_unpacklo_epi8(d, zero));
+	__m256i hi = blendHalf256(_mm256_unpackhi_epi8(s, zero),
+							  _mm256_unpackhi_epi8(d, zero));
+
+	return _mm256_or_si256(_mm256_packus_epi16(lo, hi),
+						   _mm256_set1_epi32((int)0xFF000000));
+}
+
+static SOFT_TARGET_AVX2 void blendRowAvx2(uint32_t *dst, const uint32_t *src,
+										  int n) {
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i a = _mm256_and_si256(s, alpha);
+
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alpha)) ==
+			0xFFFFFFFFu) {
+			_mm256_storeu_si256((__m256i *)(dst + i), s);
+			continue;
+		}
+
+		if (_mm256_testz_si256(a, a))
+			continue;
+
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), blend8(s, d));
+	}
+
+	blendRowScalar(dst + i, src + i, n - i);
+}
+
+static SOFT_TARGET_AVX2 void sampleAvx2(uint32_t *dst, int n,
+										const struct SoftSprite *sprite,
+										float u, float v, float du, float dv) {
+	const __m256 steps = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 w = _mm256_set1_ps((float)sprite->w);
+	const __m256 h = _mm256_set1_ps((float)sprite->h);
+	const __m256i stride = _mm256_set1_epi32(sprite->w);
+
+	__m256 us =
+		_mm256_add_ps(_mm256_set1_ps(u), _mm256_mul_ps(steps, _mm256_set1_ps(du)));
+	__m256 vs =
+		_mm256_add_ps(_mm256_set1_ps(v), _mm256_mul_ps(steps, _mm256_set1_ps(dv)));
+	__m256 du8 = _mm256_set1_ps(du * 8);
+	__m256 dv8 = _mm256_set1_ps(dv * 8);
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 inside = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(us, zero, _CMP_GE_OQ),
+						  _mm256_cmp_ps(us, w, _CMP_LT_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(vs, zero, _CMP_GE_OQ),
+						  _mm256_cmp_ps(vs, h, _CMP_LT_OQ)));
+
+		if (_mm256_movemask_ps(inside)) {
+			__m256i idx = _mm256_add_epi32(
+				_mm256_mullo_epi32(_mm256_cvttps_epi32(vs), stride),
+				_mm256_cvttps_epi32(us));
+
+			/* Lanes outside the sprite aren't read, and come back clear */
+			__m256i s = _mm256_mask_i32gather_epi32(
+				_mm256_setzero_si256(), (const int *)sprite->pixels, idx,
+				_mm256_castps_si256(inside), 4);
+			__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+			_mm256_storeu_si256((__m256i *)(dst + i), blend8(s, d));
+		}
+
+		us = _mm256_add_ps(us, du8);
+		vs = _mm256_add_ps(vs, dv8);
+	}
+
+	sampleScalar(dst + i, n - i, sprite, u + du * i, v + dv * i, du, dv);
+}
+#endif
+
+/* Must come after the renderer is created, and before any asset loads */
+bool softInit(int w, int h) {
+	frameW = activeW = w;
+	frameH = activeH = h;
+
+	stream = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+							   SDL_TEXTUREACCESS_STREAMING, frameW, frameH);
+	bakedPixels = malloc(sizeof(uint32_t) * frameW * frameH);
+	if (!stream || !bakedPixels) {
+		printf("W: Could not set up software scene renderer: %s\n",
+			   SDL_GetError());
+		softDestroy();
+		return false;
+	}
+
+	SDL_SetTextureBlendMode(stream, SDL_BLENDMODE_NONE);
+	baked.pixels = bakedPixels;
+	baked.pitch = frameW;
+
+	const char *path = "scalar";
+	blendRow = blendRowScalar;
+	rotateRow = sampleScalar;
+
+#ifdef SOFT_SSE2
+	path = "SSE2";
+	blendRow = blendRowSse2;
+	rotateRow = sampleSse2;
+#endif
+
+#ifdef SOFT_AVX2
+	if (SDL_HasAVX2()) {
+		path = "AVX2";
+		blendRow = blendRowAvx2;
+		rotateRow = sampleAvx2;
+	}
+#endif
+
+	printf("DEBUG: Drawing the scene in software (%s)\n", path);
+	enabled = true;
+	return true;
+}
+
+void softDestroy() {
+	if (stream)
+		SDL_DestroyTexture(stream);
+	free(bakedPixels);
+
+	stream = NULL;
+	bakedPixels = NULL;
+	enabled = false;
+}
+
+bool softEnabled() {
+	return enabled;
+}
+
+static void canvasClear(struct Canvas *canvas) {
+	for (int y = 0; y < activeH; y++) {
+		uint32_t *row = canvas->pixels + y * canvas->pitch;
+		for (int x = 0; x < activeW; x++)
+			row[x] = 0xFF000000;
+	}
+}
+
+/* Everything drawn until softEnd lands in the streaming texture */
+void softBegin(float drawScale) {
+	scale = drawScale;
+	activeW = SDL_max(1, SDL_min(frameW, (int)lroundf(frameW * scale)));
+	activeH = SDL_max(1, SDL_min(frameH, (int)lroundf(frameH * scale)));
+
+	void *pixels;
+	int pitch;
+	if (SDL_LockTexture(stream, NULL, &pixels, &pitch) != 0) {
+		frame.pixels = NULL;
+		return;
+	}
+
+	frame.pixels = pixels;
+	frame.pitch = pitch / (int)sizeof(uint32_t);
+	target = &frame;
+	canvasClear(&frame);
+}
+
+void softEnd() {
+	if (!frame.pixels)
+		return;
+
+	SDL_Rect drawn = {0, 0, activeW, activeH};
+	SDL_UnlockTexture(stream);
+	SDL_RenderCopy(renderer, stream, &drawn, NULL);
+	frame.pixels = NULL;
+}
+
+/* The level's walls, drawn once into a layer of their own */
+void softBakeBegin() {
+	bakedScale = scale;
+	target = &baked;
+	canvasClear(&baked);
+}
+
+void softBakeEnd() {
+	target = &frame;
+}
+
+/* A layer baked at another scale has to be drawn again */
+bool softBakeStale() {
+	return bakedScale != scale;
+}
+
+/* The layer is opaque, so it just replaces whatever was there */
+void softDrawBaked() {
+	if (!frame.pixels)
+		return;
+
+	for (int y = 0; y < activeH; y++)
+		memcpy(frame.pixels + y * frame.pitch, baked.pixels + y * baked.pitch,
+			   sizeof(uint32_t) * activeW);
+}
+
+/*
+** Keeps a copy of an image's pixels for drawing from. Takes nothing from
+** the surface, which stays with the caller.
+*/
+void softAdopt(struct Asset *asset, struct SDL_Surface *surf) {
+	softForget(asset);
+	if (!enabled)
+		return;
+
+	asset->pixels = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0);
+	if (!asset->pixels)
+		printf("W: Could not keep pixels of \"%s\" for software drawing\n",
+			   asset->path ? asset->path : "?");
+}
+
+void softForget(struct Asset *asset) {
+	for (int i = 0; i < asset->spriteCount; i++)
+		free(asset->sprites[i].pixels);
+
+	free(asset->sprites);
+	SDL_FreeSurface(asset->pixels);
+
+	asset->sprites = NULL;
+	asset->spriteCount = 0;
+	asset->pixels = NULL;
+}
+
+/* The asset scaled to w by h, then turned clockwise a quarter at a time */
+static struct SoftSprite *softPrepare(struct Asset *asset, int w, int h,
+									  int turns) {
+	for (int i = 0; i < asset->spriteCount; i++) {
+		struct SoftSprite *sprite = &asset->sprites[i];
+		if (sprite->sw == w && sprite->sh == h && sprite->turns == turns)
+			return sprite;
+	}
+
+	/* Sizes in use hardly ever change; if they do, start over */
+	if (asset->spriteCount == SOFT_MAX_SPRITES) {
+		for (int i = 0; i < asset->spriteCount; i++)
+			free(asset->sprites[i].pixels);
+		asset->spriteCount = 0;
+	}
+
+	if (!asset->sprites) {
+		asset->sprites = malloc(sizeof(struct SoftSprite) * SOFT_MAX_SPRITES);
+		if (!asset->sprites) {
+			puts("E: Out of memory while preparing sprite");
+			exit(1);
+		}
+	}
+
+	struct SoftSprite *sprite = &asset->sprites[asset->spriteCount];
+	sprite->sw = w;
+	sprite->sh = h;
+	sprite->turns = turns;
+	sprite->w = turns & 1 ? h : w;
+	sprite->h = turns & 1 ? w : h;
+	sprite->pixels = malloc(sizeof(uint32_t) * w * h);
+	if (!sprite->pixels) {
+		puts("E: Out of memory while preparing sprite");
+		exit(1);
+	}
+
+	SDL_Surface *src = asset->pixels;
+	const uint8_t *srcPixels = src->pixels;
+
+	for (int y = 0; y < sprite->h; y++) {
+		for (int x = 0; x < sprite->w; x++) {
+			/* Back from the turned sprite to the upright, scaled one */
+			int ux, uy;
+			switch (turns) {
+			case 1:
+				ux = y;
+				uy = h - 1 - x;
+				break;
+			case 2:
+				ux = w - 1 - x;
+				uy = h - 1 - y;
+				break;
+			case 3:
+				ux = w - 1 - y;
+				uy = x;
+				break;
+			default:
+				ux = x;
+				uy = y;
+				break;
+			}
+
+			int sx = ux * src->w / w;
+			int sy = uy * src->h / h;
+			const uint32_t *row =
+				(const uint32_t *)(srcPixels + sy * src->pitch);
+			sprite->pixels[y * sprite->w + x] = row[sx];
+		}
+	}
+
+	asset->spriteCount++;
+	return sprite;
+}
+
+static void softBlit(const struct SoftSprite *sprite, int x, int y) {
+	int x0 = SDL_max(x, 0), y0 = SDL_max(y, 0);
+	int x1 = SDL_min(x + sprite->w, activeW);
+	int y1 = SDL_min(y + sprite->h, activeH);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int row = y0; row < y1; row++)
+		blendRow(target->pixels + row * target->pitch + x0,
+				 sprite->pixels + (row - y) * sprite->w + (x0 - x), x1 - x0);
+}
+
+/*
+** Walks the rotated sprite's bounding box, mapping each pixel back into
+** the upright sprite. Along a row that mapping is a constant step.
+*/
+static void softRotate(const struct SoftSprite *sprite, float cx, float cy,
+					   double angle) {
+	double rad = angle * M_PI / 180.0;
+	float c = (float)cos(rad), s = (float)sin(rad);
+	float hw = sprite->w / 2.0f, hh = sprite->h / 2.0f;
+
+	float ex = fabsf(c) * hw + fabsf(s) * hh;
+	float ey = fabsf(s) * hw + fabsf(c) * hh;
+
+	int x0 = SDL_max((int)floorf(cx - ex), 0);
+	int y0 = SDL_max((int)floorf(cy - ey), 0);
+	int x1 = SDL_min((int)ceilf(cx + ex), activeW);
+	int y1 = SDL_min((int)ceilf(cy + ey), activeH);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int y = y0; y < y1; y++) {
+		float px = x0 + 0.5f - cx;
+		float py = y + 0.5f - cy;
+
+		float u = px * c + py * s + hw;
+		float v = -px * s + py * c + hh;
+
+		rotateRow(target->pixels + y * target->pitch + x0, x1 - x0, sprite, u,
+				  v, c, -s);
+	}
+}
+
+/* As SDL_RenderCopyEx: scaled to place, turned clockwise about its centre */
+void softDraw(struct Asset *asset, const SDL_FRect *place, double angle) {
+	if (!target->pixels || !asset->pixels)
+		return;
+
+	int w = (int)lroundf(place->w * scale), h = (int)lroundf(place->h * scale);
+	if (w <= 0 || h <= 0)
+		return;
+
+	float cx = (place->x + place->w / 2.0f) * scale;
+	float cy = (place->y + place->h / 2.0f) * scale;
+
+	double turn = fmod(angle, 360.0);
+	if (turn < 0)
+		turn += 360.0;
+
+	if (fmod(turn, 90.0) != 0.0) {
+		softRotate(softPrepare(asset, w, h, 0), cx, cy, turn);
+		return;
+	}
+
+	struct SoftSprite *sprite = softPrepare(asset, w, h, (int)(turn / 90.0));
+	softBlit(sprite, (int)lroundf(cx - sprite->w / 2.0f),
+			 (int)lroundf(cy - sprite->h / 2.0f));
+}
@@ -10,14 +10,38 @@
 #define TANK_H_INCLUDED
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_events.h>
 #include <SDL2/SDL_pixels.h>
+#include <SDL2/SDL_scancode.h>
 #include <SDL2/SDL_render.h>
 
-#define PARSE_MAX_LINE_LENGTH 50
-#define LVL_MAX_ENTITY_COUNT 1000
-#define UI_MAX_HUD_ELEMS 75
+#define LVL_FILE_VERSION 1
+#define LVL_MAX_PATH 4096
+#define LVL_MAX_NODES 65536
+#define RPL_FILE_VERSION 2
+#define BATCH_MAX_TEXTURES 16
+#define GRID_CELL_SIZE 64
+#define PROF_HISTORY 240
+#define PACE_MAX_CATCHUP 5
+#define INPUT_QUEUE_SIZE 256
+#define TEXT_ATLAS_W 2048
+#define TEXT_ATLAS_H 1024
+#define TEXT_FIRST_GLYPH 32
+#define TEXT_LAST_GLYPH 126
+#define UI_LABEL_MAX_TEXT 64
+#define UI_MAX_OVERLAP 8
+#define UI_IDLE_WAIT_MS 100
+#define TWEEN_MAX 128
+#define SOFT_MAX_SPRITES 8
+#define LEVEL_LOAD_MAX_TEXTURES 16
+#define LEVEL_CHUNK_SIZE 512
+#define LEVEL_MAX_CHUNKS 16
+#define ASSET_MAX_DECODERS 8
+#define TEX_CACHE_VERSION 1
 
 /* General */
 void printBanner();
@@ -32,6 +56,12 @@ void startGame();
 void render();
 void tick();
 
+/* Frame pacing */
+void paceInit(double tps, double fps, bool useVsync);
+void paceReset();
+int paceTicksDue();
+void paceWait();
+
 /* Game state */
 enum GameState {
 	fsMenu = 1,	 /* Full screen menu */
@@ -39,36 +69,213 @@ enum GameState {
 	game = 3,	 /* Playing the main game */
 	failure = 4, /* You failed */
 	success = 5, /* You won */
+	loading = 6, /* Waiting on a level to load */
+};
+
+/* Asset cache */
+struct SoftSprite;
+
+struct Asset {
+	char *path;
+	int refs;
+	bool pinned;
+
+	int w, h;
+	struct SDL_Texture *texture;
+
+	/* Only kept when drawing in software; see soft.c */
+	struct SDL_Surface *pixels;
+	int spriteCount;
+	struct SoftSprite *sprites;
+};
+
+struct Asset *assetAcquire(const char *path);
+struct Asset *assetAcquireSurface(const char *path, struct SDL_Surface *surf);
+void assetRetain(struct Asset *asset);
+bool assetCached(const char *path);
+bool assetReload(const char *path);
+void assetsPreload();
+void assetRelease(struct Asset *asset);
+void assetsDestroy();
+
+/* Sprite batching */
+void batchBegin();
+void batchAdd(struct Asset *texture, const SDL_Rect *place, double angle);
+void batchAddRegion(struct SDL_Texture *texture, const SDL_Rect *src,
+					const SDL_FRect *dst, SDL_Color color);
+void batchFlush();
+void batchDestroy();
+
+/* Software scene rendering */
+struct SoftSprite {
+	int sw, sh; /* The size asked for, before turning */
+	int turns;	/* Clockwise quarter turns */
+
+	int w, h;
+	uint32_t *pixels;
+};
+
+bool softInit(int w, int h);
+void softDestroy();
+bool softEnabled();
+void softBegin(float drawScale);
+void softEnd();
+void softBakeBegin();
+void softBakeEnd();
+bool softBakeStale();
+void softDrawBaked();
+void softAdopt(struct Asset *asset, struct SDL_Surface *surf);
+void softForget(struct Asset *asset);
+void softDraw(struct Asset *asset, const SDL_FRect *place, double angle);
+
+/* Dynamic resolution */
+void scaleInit(int w, int h, bool useDynamic);
+void scaleDestroy();
+void scaleSetBudget(double ms, bool useVsync);
+void scaleLogicalSize(int *w, int *h);
+float scaleFactor();
+void scaleUpdate();
+void scaleBegin();
+void scaleEnd();
+
+/* Text */
+enum TextSize {
+	TEXT_SMALL = 0,
+	TEXT_MEDIUM,
+	TEXT_LARGE,
+	TEXT_SIZE_COUNT,
+};
+
+bool textInit(const char *fontPath);
+void textDestroy();
+int textLineHeight(enum TextSize size);
+void textMeasure(enum TextSize size, const char *text, int *w, int *h);
+void textDrawScaled(enum TextSize size, const char *text, float x, float y,
+					float sx, float sy, SDL_Color color);
+void textDraw(enum TextSize size, const char *text, int x, int y,
+			  SDL_Color color);
+void textDrawFit(enum TextSize size, const char *text, const SDL_Rect *box,
+				 SDL_Color color);
+
+/* Profiler */
+enum ProfilePhase {
+	PROF_FRAME = 0,
+	PROF_EVENTS,
+	PROF_TICK,
+	PROF_MENU_TICK,
+	PROF_LEVEL_TICK,
+	PROF_TANK_TICK,
+	PROF_RENDER,
+	PROF_MENU_RENDER,
+	PROF_LEVEL_RENDER,
+	PROF_TANK_RENDER,
+	PROF_HUD_RENDER,
+	PROF_PRESENT,
+	PROF_PHASE_COUNT,
+};
+
+/* All in milliseconds */
+struct ProfileStats {
+	float min, avg, p99, max;
+	int samples;
+};
+
+void profileBegin(enum ProfilePhase phase);
+void profileEnd(enum ProfilePhase phase);
+const char *profileName(enum ProfilePhase phase);
+void profileStats(enum ProfilePhase phase, struct ProfileStats *out);
+int profileHistory(enum ProfilePhase phase, float *out, int max);
+
+/* Tracing */
+void traceOpen(char *path);
+bool traceEnabled();
+void traceBegin(const char *name);
+void traceEnd(const char *name);
+void traceThreadName(const char *name);
+void traceFlush();
+
+/* Spatial index */
+struct GridEntry {
+	int32_t cx, cy;
+	uint32_t id;
+	SDL_Rect bounds;
+
+	bool used;
+	int32_t next;
+};
+
+struct Grid {
+	uint32_t bucketMask;
+	int32_t *buckets;
+
+	struct GridEntry *entries;
+	int32_t entryCount;
+	int32_t entryCapacity;
+	int32_t freeList;
+	uint32_t liveCount;
 };
 
+void gridInit(struct Grid *grid);
+void gridDestroy(struct Grid *grid);
+void gridInsert(struct Grid *grid, uint32_t id, const SDL_Rect *bounds);
+void gridRemove(struct Grid *grid, uint32_t id, const SDL_Rect *bounds);
+int gridQueryRect(struct Grid *grid, const SDL_Rect *area, uint32_t *out,
+				  int max);
+int gridQueryPoint(struct Grid *grid, int x, int y, uint32_t *out, int max);
+int gridQueryRadius(struct Grid *grid, int x, int y, int radius, uint32_t *out,
+					int max);
+
 /* Menus */
+enum WidgetType {
+	WIDGET_ROOT = 0,
+	WIDGET_LABEL = 1,
+	WIDGET_BUTTON = 2,
+	WIDGET_IMAGE = 3,
+	WIDGET_PARTIAL_IMAGE = 4,
+};
+
+/*
+** Every widget starts with one of these, which links it into its menu's
+** tree. A widget's own rect is relative to its parent; bounds caches where
+** that put it on screen as of the last layout.
+*/
+struct Widget {
+	enum WidgetType type;
+	uint32_t id;
+
+	struct Widget *parent;
+	struct Widget *firstChild;
+	struct Widget *lastChild;
+	struct Widget *next;
+
+	SDL_Rect bounds;
+};
+
 struct Label {
+	struct Widget node;
 	SDL_Rect location;
 
-	char *text;
+	char text[UI_LABEL_MAX_TEXT];
+	enum TextSize size;
 	struct SDL_Color color[2];
 
-	struct SDL_Texture *texture;
-
 	void (*onFrame)(struct Label *target);
 	void (*onTick)(struct Label *target);
 };
 
 struct Button {
+	struct Widget node;
 	bool focused;
 
-	bool wasFocused;
-	bool wasClicked;
-
 	struct SDL_Rect place;
 
 	char *text;
 
 	struct SDL_Texture *focusTextTex;
-	struct SDL_Texture *focusBackTex;
+	struct Asset *focusBackTex;
 
 	struct SDL_Texture *unfocusTextTex;
-	struct SDL_Texture *unfocusBackTex;
+	struct Asset *unfocusBackTex;
 
 	void (*onFocus)();
 	void (*onClick)();
@@ -77,22 +284,26 @@ struct Button {
 };
 
 struct Image {
+	struct Widget node;
 	SDL_Rect location;
 	float rotation;
+	uint8_t alpha;
 
-	struct SDL_Texture *imageTexture;
+	struct Asset *imageTexture;
 
 	void (*onFrame)(struct Image *target);
 	void (*onTick)(struct Image *target);
 };
 
 struct PartialImage {
+	struct Widget node;
 	SDL_Rect location;
 	SDL_Rect imagePortion;
 
 	float rotation;
+	uint8_t alpha;
 
-	struct SDL_Texture *imageTexture;
+	struct Asset *imageTexture;
 
 	void (*onFrame)(struct PartialImage *target);
 	void (*onTick)(struct PartialImage *target);
@@ -101,23 +312,38 @@ struct PartialImage {
 struct Menu {
 	bool fullScreen;
 
-	uint8_t labelCount;
-	struct Label *labels[UI_MAX_HUD_ELEMS];
+	struct Widget root;
 
-	uint8_t buttonCount;
-	struct Button *buttons[UI_MAX_HUD_ELEMS];
+	/* The tree flattened in draw order; a widget's id is its index here */
+	uint32_t widgetCount;
+	uint32_t widgetCapacity;
+	struct Widget **widgets;
+	bool treeChanged;
 
-	uint8_t imageCount;
-	struct Image *images[UI_MAX_HUD_ELEMS];
+	/* Buttons by their on-screen bounds, to find what the mouse is over */
+	struct Grid hits;
+	int mouseX, mouseY;
 
-	uint8_t partialImageCount;
-	struct PartialImage *partialImages[UI_MAX_HUD_ELEMS];
+	struct Button *focus;
+	bool focusByKey;
+	struct Button *pressed;
+
+	/* Something on screen is out of date, so the next frame must draw */
+	bool dirty;
 };
 
 void menuInit(struct Menu *menu);
 void menuDestroy(struct Menu *menu);
 void menuRender(struct Menu *menu);
 void menuTick(struct Menu *menu);
+void menuHandleEvent(struct Menu *menu, const SDL_Event *e);
+bool menuDirty(struct Menu *menu);
+void menuInvalidate(struct Menu *menu);
+
+void menuAttach(struct Menu *menu, struct Widget *parent,
+				struct Widget *child);
+void widgetDirty(struct Widget *widget);
+SDL_Rect *widgetRect(struct Widget *widget);
 
 void menuAddLabel(struct Menu *menu, struct Label *label);
 void menuAddButton(struct Menu *menu, struct Button *button);
@@ -126,6 +352,7 @@ void menuAddPartialImage(struct Menu *menu, struct PartialImage *image);
 
 void labelInit(struct Label *label, char *text, struct SDL_Color fg,
 			   struct SDL_Color bg, int x, int y, int w, int h);
+void labelSetText(struct Label *label, const char *text);
 void labelDestroy(struct Label *label);
 void labelRender(struct Label *label);
 void labelTick(struct Label *label);
@@ -150,27 +377,90 @@ void partialImageDestroy(struct PartialImage *image);
 void partialImageRender(struct PartialImage *image);
 void partialImageTick(struct PartialImage *image);
 
+/* Widget animation */
+enum TweenProperty {
+	TWEEN_X = 0,
+	TWEEN_Y = 1,
+	TWEEN_W = 2,
+	TWEEN_H = 3,
+	TWEEN_ROTATION = 4,
+	TWEEN_ALPHA = 5,
+};
+
+enum Ease {
+	EASE_LINEAR = 0,
+	EASE_IN_QUAD = 1,
+	EASE_OUT_QUAD = 2,
+	EASE_IN_OUT_QUAD = 3,
+	EASE_OUT_CUBIC = 4,
+	EASE_OUT_BACK = 5,
+};
+
+void tweenStart(struct Widget *widget, enum TweenProperty property, float to,
+				uint32_t ms, enum Ease curve,
+				void (*onDone)(struct Widget *widget));
+void tweenCancel(struct Widget *widget);
+bool tweenRunning(struct Widget *widget);
+void tweensTick(float ms);
+
+/* Pack archive */
+bool packOpen();
+void packClose();
+bool packFind(const char *name, const void **data, size_t *size);
+bool packLoosePath(const char *name, char *buf, size_t len);
+bool packStat(const char *name, uint64_t *size, int64_t *mtime);
+struct SDL_RWops *packOpenRW(const char *name);
+
+/* Decoded texture cache */
+void texCacheInit(const char *dir);
+void texCacheDestroy();
+struct SDL_Surface *texCacheLoad(const char *path);
+struct SDL_Surface *texCacheStore(const char *path, struct SDL_Surface *surf);
+
+/* Hot reload, for development */
+enum HotChange {
+	HOT_NONE = 0,
+	HOT_LEVEL = 1,	 /* The current level's file changed */
+	HOT_TEXTURE = 2, /* At least one texture was reloaded */
+};
+
+bool hotInit();
+void hotDestroy();
+int hotPoll();
+
+/* Camera */
+void cameraFollow(SDL_Rect *camera, int worldW, int worldH, float x, float y);
+void cameraToWorld(const SDL_Rect *camera, int x, int y, int *worldX,
+				   int *worldY);
+
 /* Util */
+struct SDL_Surface *decodeTexture(const char *texPath);
 struct SDL_Surface *loadTexture(const char *texPath);
 void initRandom();
 int randint(int min, int max);
 
 /* Tank/player manager */
+struct Level;
+
 struct Player {
 	uint8_t health;
 
 	int x, y;
 	double heading;
 
-	struct SDL_Surface *texSurface;
-	struct SDL_Texture *texture;
+	/* Where we were as of the previous tick, for interpolation */
+	int prevX, prevY;
+	double prevHeading;
+
+	struct Asset *texture;
 };
 
 void tankInit(struct Player *player);
 void tankDestroy(struct Player *player);
 
-void tankRender(struct Player *player);
-void tankTick(struct Player *player, long milisTime);
+void tankFocus(struct Player *player, double alpha, float *x, float *y);
+void tankRender(struct Player *player, double alpha, const SDL_Rect *camera);
+void tankTick(struct Player *player, struct Level *level, long milisTime);
 
 /* Level manager */
 enum EntityType { wall = 0, enemy = 1, goal = 2 };
@@ -185,10 +475,21 @@ struct Entity {
 	int x, y;
 	uint8_t orientation;
 
-	bool isRemoved;
+	uint32_t slot;
+	struct Asset *texture;
+};
 
-	struct SDL_Surface *texSurface;
-	struct SDL_Texture *texture;
+/* Generation in the high half, slot in the low half */
+typedef uint64_t EntityID;
+#define ENTITY_NONE ((EntityID)0)
+#define ENTITY_SLOT_NIL UINT32_MAX
+
+struct EntitySlot {
+	uint32_t generation;
+	bool live;
+
+	/* Dense index while live, next free slot otherwise */
+	uint32_t index;
 };
 
 struct TankNode {
@@ -198,6 +499,13 @@ struct TankNode {
 	enum NodeType type;
 };
 
+struct StaticChunk {
+	int cx, cy;
+	struct SDL_Texture *texture;
+	bool valid;
+	uint32_t lastUsed;
+};
+
 struct Level {
 	int levelIndex;
 	char *levelFile;
@@ -205,26 +513,220 @@ struct Level {
 	int startPoint[2];
 
 	uint32_t entityCount;
-	struct Entity *ents[LVL_MAX_ENTITY_COUNT];
+	uint32_t entityCapacity;
+	struct Entity *ents;
+
+	uint32_t slotCount;
+	uint32_t slotCapacity;
+	uint32_t freeSlot;
+	struct EntitySlot *slots;
+
+	struct Grid grid;
+
+	/* Bumped by the simulation whenever a static entity changes */
+	uint32_t staticVersion;
+
+	/* How far entities reach, and what was on screen as of the last tick */
+	int width, height;
+	SDL_Rect camera;
+
+	/* Drawing's own copy of the walls, indexed to find those in view */
+	uint32_t viewVersion;
+	uint32_t viewStaticCount;
+	struct Entity *viewStatics;
+	uint32_t *viewHits;
+	struct Grid viewGrid;
+
+	/* Walls pre-drawn a chunk at a time; see levelRender */
+	struct StaticChunk chunks[LEVEL_MAX_CHUNKS];
+	uint32_t chunkClock;
+	SDL_Rect bakedView;
+	bool staticDirty;
 
 	int maxNodes;
 	int nodesUsed;
 	struct TankNode *nodes;
 };
 
+/* On-disk level data; see lvlfile.c for the formats */
+struct LevelHeader {
+	char magic[4];
+	uint32_t byteOrder;
+	uint32_t version;
+
+	int32_t start[2];
+	int32_t maxNodes;
+	uint32_t entityCount;
+};
+
+struct LevelRecord {
+	uint8_t type;
+	uint8_t orientation;
+	uint8_t health;
+	uint8_t canDamage;
+
+	int32_t x, y;
+};
+
+struct LevelFile {
+	char path[LVL_MAX_PATH];
+
+	struct LevelHeader header;
+	const struct LevelRecord *records;
+
+	/* Backing storage for whichever format was loaded */
+	struct LevelRecord *owned;
+	uint32_t ownedCapacity;
+	void *map;
+	size_t mapSize;
+};
+
+bool levelFileOpen(struct LevelFile *file, uint32_t levelID);
+bool levelFileLoadText(struct LevelFile *file, const char *path);
+void levelFileClose(struct LevelFile *file);
+bool levelFileWrite(const struct LevelFile *file, const char *path);
+int levelCompile(const char *textPath);
+
 void levelInit(struct Level *level, struct Player *player, uint32_t levelID);
 void levelDestroy(struct Level *level);
-int addEntity(struct Level *level, enum EntityType type, uint8_t initialHealth,
-			  bool canDamage, int x, int y, uint8_t oriantation);
-void removeEntity();
-
-void levelRender(struct Level *level);
+EntityID addEntity(struct Level *level, enum EntityType type,
+				   uint8_t initialHealth, bool canDamage, int x, int y,
+				   uint8_t orientation);
+struct Entity *levelEntity(struct Level *level, EntityID id);
+void removeEntity(struct Level *level, EntityID id);
+void damageEntity(struct Level *level, EntityID id, uint8_t amount);
+void levelInvalidateStatic(struct Level *level);
+void entityBounds(struct Entity *ent, SDL_Rect *out);
+bool levelCollides(struct Level *level, const SDL_Rect *area);
+
+struct WorldSnapshot;
+
+void levelSnapshot(struct Level *level, struct WorldSnapshot *snap);
+void levelRender(struct Level *level, struct WorldSnapshot *snap,
+				 const SDL_Rect *camera);
 void levelTick(struct Level *level, long milisTime);
 
+/* Level loading, possibly in the background; see level.c */
+struct LevelLoad {
+	struct Level *level;
+	uint32_t levelID;
+
+	struct SDL_Thread *thread;
+	bool failed;
+	const char *missing; /* The texture that failed to decode, if one did */
+
+	/* Written by the loader, read by anyone */
+	SDL_atomic_t done;
+	SDL_atomic_t total;
+	SDL_atomic_t finished;
+	SDL_atomic_t cancelled;
+
+	int surfaceCount;
+	const char *surfacePaths[LEVEL_LOAD_MAX_TEXTURES];
+	bool cached[LEVEL_LOAD_MAX_TEXTURES];
+	struct SDL_Surface *surfaces[LEVEL_LOAD_MAX_TEXTURES];
+};
+
+void levelLoadStart(struct LevelLoad *load, struct Level *level,
+					uint32_t levelID, bool threaded);
+bool levelLoadDone(struct LevelLoad *load);
+float levelLoadProgress(struct LevelLoad *load);
+void levelLoadFinish(struct LevelLoad *load, struct Player *player);
+void levelLoadCancel(struct LevelLoad *load);
+
+/* Simulation thread */
+struct WorldSnapshot {
+	uint32_t tick;
+	uint64_t published; /* Performance counter as of publishing */
+
+	struct Player player;
+	int worldW, worldH;
+
+	/* Only copied again when the level's staticVersion moves on */
+	uint32_t staticVersion;
+	uint32_t staticCount;
+	uint32_t staticCapacity;
+	struct Entity *statics;
+
+	uint32_t dynamicCount;
+	uint32_t dynamicCapacity;
+	struct Entity *dynamics;
+
+	int maxNodes;
+	int nodesUsed;
+	uint32_t nodeCapacity;
+	struct TankNode *nodes;
+};
+
+bool simStart(double tps, struct Level *level, struct Player *player,
+			  void (*tick)());
+void simStop();
+bool simThreaded();
+void simSetActive(bool run);
+void simLock();
+void simUnlock();
+void simPublish();
+struct WorldSnapshot *simLatest();
+double simAlpha(const struct WorldSnapshot *snap);
+
 /* Input handler */
-void updateKeys(char key, bool down);
-void updateMice(uint8_t button, bool pressed);
-bool isKeyDown(char key);
+enum InputEventType {
+	INPUT_KEY = 0,
+	INPUT_MOUSEBUTTON = 1,
+	INPUT_MOUSEMOVE = 2,
+};
+
+struct InputEvent {
+	uint32_t time;
+	uint8_t type;
+	bool down;
+	uint16_t code;
+	int x, y;
+};
+
+void updateKeys(uint16_t scancode, bool down);
+void updateMice(uint8_t button, bool pressed, int x, int y);
+void updateMouse(int x, int y);
+void inputBeginTick();
+const struct InputEvent *inputEvents(int *count);
+bool isKeyDown(SDL_Scancode key);
+bool isKeyPressed(SDL_Scancode key);
+bool isKeyReleased(SDL_Scancode key);
 bool isMousePressed(uint8_t button);
+bool isMouseClicked(uint8_t button);
+bool isMouseReleased(uint8_t button);
+void getMousePosition(int *x, int *y);
+void getTickMousePosition(int *x, int *y);
+
+/* Input recording and replay */
+enum ReplayRecordType {
+	RPL_KEY = 0,
+	RPL_MOUSEBUTTON = 1,
+	RPL_MOUSEMOVE = 2,
+	RPL_END = 3,
+};
+
+struct ReplayHeader {
+	char magic[4];
+	uint32_t version;
+	int32_t level;
+	double tps;
+};
+
+struct ReplayRecord {
+	uint32_t tick;
+	uint8_t type;
+	uint8_t down;
+	uint16_t code;
+	int16_t x, y;
+};
+
+bool replayRecordStart(const char *path, int level, double tps);
+void replayCapture(uint8_t type, uint16_t code, bool down, int x, int y);
+bool replayPlayStart(const char *path, int *level, double *tps);
+bool replayPlaying();
+bool replayFinished();
+void replayFeed();
+void replayStop();
 
 #endif
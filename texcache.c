@@ -0,0 +1,196 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Decoded texture cache routines
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>
+
+#include "pack.h"
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** With -D, every image decoded is also written to the given directory,
+** already converted to the pixel format the renderer prefers. Next time
+** the image is wanted it is read straight back from there, skipping both
+** PNG decompression and format conversion at upload.
+**
+** Entries are named by a hash of the image's path, and their header holds
+** the path itself plus the size and modification time of its source.
+** If any of those differ, the entry is simply decoded and written again.
+** Entries are written under a temporary name and renamed into place, so
+** decoder threads racing on the same image can't see half a file.
+*/
+static const char tex_magic[4] = {'T', 'N', 'K', 'T'};
+
+struct TexCacheHeader {
+	char magic[4];
+	uint32_t version;
+
+	uint32_t format;
+	int32_t w, h;
+	int32_t pitch;
+
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+
+	uint32_t pathLength;
+};
+
+static char *cacheDir = NULL;
+static uint32_t cacheFormat = SDL_PIXELFORMAT_ARGB8888;
+
+/* The first format the renderer takes natively that keeps alpha */
+static uint32_t preferredFormat() {
+	SDL_RendererInfo info;
+	if (!renderer || SDL_GetRendererInfo(renderer, &info) != 0)
+		return SDL_PIXELFORMAT_ARGB8888;
+
+	for (uint32_t i = 0; i < info.num_texture_formats; i++) {
+		uint32_t fmt = info.texture_formats[i];
+		if (!SDL_ISPIXELFORMAT_FOURCC(fmt) && SDL_ISPIXELFORMAT_ALPHA(fmt))
+			return fmt;
+	}
+
+	return SDL_PIXELFORMAT_ARGB8888;
+}
+
+/* Must come after the renderer is created */
+void texCacheInit(const char *dir) {
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		printf("W: Could not create texture cache \"%s\"; not caching\n",
+			   dir);
+		return;
+	}
+
+	cacheDir = malloc(strlen(dir) + 1);
+	if (cacheDir)
+		strcpy(cacheDir, dir);
+
+	cacheFormat = preferredFormat();
+}
+
+void texCacheDestroy() {
+	free(cacheDir);
+	cacheDir = NULL;
+}
+
+static void entryPath(const char *path, char *buf, size_t len) {
+	snprintf(buf, len, "%s/%016llx.tex", cacheDir,
+			 (unsigned long long)packHash(path, strlen(path)));
+}
+
+struct SDL_Surface *texCacheLoad(const char *path) {
+	uint64_t size;
+	int64_t mtime;
+	if (!cacheDir || !packStat(path, &size, &mtime))
+		return NULL;
+
+	char entry[LVL_MAX_PATH];
+	entryPath(path, entry, sizeof(entry));
+
+	FILE *fp = fopen(entry, "rb");
+	if (!fp)
+		return NULL;
+
+	struct TexCacheHeader header;
+	char stored[LVL_MAX_PATH];
+	size_t pathLength = strlen(path);
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+		memcmp(header.magic, tex_magic, sizeof(tex_magic)) != 0 ||
+		header.version != TEX_CACHE_VERSION || header.format != cacheFormat ||
+		header.sourceSize != size || header.sourceMtime != mtime ||
+		header.pathLength != pathLength || pathLength >= sizeof(stored) ||
+		fread(stored, 1, pathLength, fp) != pathLength ||
+		memcmp(stored, path, pathLength) != 0 || header.w <= 0 ||
+		header.h <= 0) {
+		fclose(fp);
+		return NULL;
+	}
+
+	SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(
+		0, header.w, header.h, SDL_BITSPERPIXEL(header.format), header.format);
+	if (!surf || surf->pitch != header.pitch) {
+		SDL_FreeSurface(surf);
+		fclose(fp);
+		return NULL;
+	}
+
+	size_t bytes = (size_t)surf->pitch * surf->h;
+	bool ok = fread(surf->pixels, 1, bytes, fp) == bytes;
+	fclose(fp);
+
+	if (!ok) {
+		SDL_FreeSurface(surf);
+		return NULL;
+	}
+
+	return surf;
+}
+
+/*
+** Converts a freshly decoded image to the cache's format and stores it.
+** Hands back the converted surface in place of the one given, which is
+** freed; if anything goes wrong, the original comes back untouched.
+*/
+struct SDL_Surface *texCacheStore(const char *path, struct SDL_Surface *surf) {
+	uint64_t size;
+	int64_t mtime;
+	if (!cacheDir || !packStat(path, &size, &mtime))
+		return surf;
+
+	SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, cacheFormat, 0);
+	if (!conv)
+		return surf;
+
+	SDL_FreeSurface(surf);
+
+	char entry[LVL_MAX_PATH], temp[LVL_MAX_PATH + 32];
+	entryPath(path, entry, sizeof(entry));
+	snprintf(temp, sizeof(temp), "%s.%lu", entry, SDL_ThreadID());
+
+	struct TexCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, tex_magic, sizeof(tex_magic));
+	header.version = TEX_CACHE_VERSION;
+	header.format = conv->format->format;
+	header.w = conv->w;
+	header.h = conv->h;
+	header.pitch = conv->pitch;
+	header.sourceSize = size;
+	header.sourceMtime = mtime;
+	header.pathLength = (uint32_t)strlen(path);
+
+	FILE *fp = fopen(temp, "wb");
+	if (!fp)
+		return conv;
+
+	size_t bytes = (size_t)conv->pitch * conv->h;
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			  fwrite(path, 1, header.pathLength, fp) == header.pathLength &&
+			  fwrite(conv->pixels, 1, bytes, fp) == bytes;
+
+	if (fclose(fp) != 0)
+		ok = false;
+
+	if (!ok || rename(temp, entry) != 0)
+		remove(temp);
+
+	return conv;
+}
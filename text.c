@@ -0,0 +1,221 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Glyph atlas text rendering routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "tank.h"
+
+extern struct SDL_Renderer *renderer;
+
+/*
+** Every printable ASCII glyph is rasterised once, at each TextSize, into
+** a single white atlas texture. Text is then just a quad per character
+** added to the sprite batch, tinted by vertex colour, so changing what a
+** label says costs nothing but a string copy. Anything outside the atlas
+** is drawn as a space.
+**
+** Glyphs are packed in rows left to right, a new row starting whenever
+** one fills up. Kerning is ignored; the game font is monospaced anyway.
+*/
+struct Glyph {
+	SDL_Rect src;
+	int advance;
+};
+
+struct GlyphSet {
+	int lineSkip;
+	int height;
+	struct Glyph glyphs[TEXT_LAST_GLYPH - TEXT_FIRST_GLYPH + 1];
+};
+
+static const int textPointSizes[TEXT_SIZE_COUNT] = {
+	[TEXT_SMALL] = 10,
+	[TEXT_MEDIUM] = 24,
+	[TEXT_LARGE] = 72,
+};
+
+static struct GlyphSet sets[TEXT_SIZE_COUNT];
+static struct SDL_Texture *atlas = NULL;
+
+static bool packSet(TTF_Font *font, struct GlyphSet *set, SDL_Surface *dest,
+					int *penX, int *penY, int *rowH) {
+	SDL_Color white = {255, 255, 255, 255};
+
+	set->lineSkip = TTF_FontLineSkip(font);
+	set->height = TTF_FontHeight(font);
+
+	for (int ch = TEXT_FIRST_GLYPH; ch <= TEXT_LAST_GLYPH; ch++) {
+		struct Glyph *g = &set->glyphs[ch - TEXT_FIRST_GLYPH];
+
+		int minx, maxx, miny, maxy;
+		if (TTF_GlyphMetrics(font, (Uint16)ch, &minx, &maxx, &miny, &maxy,
+							 &g->advance) < 0)
+			g->advance = 0;
+
+		SDL_Surface *surf = TTF_RenderGlyph_Blended(font, (Uint16)ch, white);
+		if (!surf) {
+			g->src = (SDL_Rect){0, 0, 0, 0};
+			continue;
+		}
+
+		if (*penX + surf->w > TEXT_ATLAS_W) {
+			*penX = 0;
+			*penY += *rowH + 1;
+			*rowH = 0;
+		}
+
+		if (*penY + surf->h > TEXT_ATLAS_H) {
+			SDL_FreeSurface(surf);
+			return false;
+		}
+
+		g->src = (SDL_Rect){*penX, *penY, surf->w, surf->h};
+
+		/* Copy the coverage straight in rather than blending it */
+		SDL_SetSurfaceBlendMode(surf, SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(surf, NULL, dest, &g->src);
+
+		*penX += surf->w + 1;
+		*rowH = SDL_max(*rowH, surf->h);
+		SDL_FreeSurface(surf);
+	}
+
+	return true;
+}
+
+bool textInit(const char *fontPath) {
+	traceBegin("textInit");
+
+	SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(
+		0, TEXT_ATLAS_W, TEXT_ATLAS_H, 32, SDL_PIXELFORMAT_ARGB8888);
+	if (!surf) {
+		traceEnd("textInit");
+		return false;
+	}
+
+	SDL_FillRect(surf, NULL, 0);
+
+	int penX = 0, penY = 0, rowH = 0;
+	bool ok = true;
+
+	for (int i = 0; i < TEXT_SIZE_COUNT && ok; i++) {
+		SDL_RWops *data = packOpenRW(fontPath);
+		TTF_Font *font =
+			data ? TTF_OpenFontRW(data, 1, textPointSizes[i]) : NULL;
+		if (!font) {
+			ok = false;
+			break;
+		}
+
+		ok = packSet(font, &sets[i], surf, &penX, &penY, &rowH);
+		TTF_CloseFont(font);
+
+		if (!ok)
+			puts("W: Text glyphs do not fit in the atlas");
+	}
+
+	if (ok) {
+		atlas = SDL_CreateTextureFromSurface(renderer, surf);
+		if (atlas)
+			SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+		ok = atlas != NULL;
+	}
+
+	SDL_FreeSurface(surf);
+	traceEnd("textInit");
+	return ok;
+}
+
+void textDestroy() {
+	if (atlas)
+		SDL_DestroyTexture(atlas);
+
+	atlas = NULL;
+}
+
+static const struct Glyph *glyphFor(const struct GlyphSet *set, char ch) {
+	if (ch < TEXT_FIRST_GLYPH || ch > TEXT_LAST_GLYPH)
+		ch = ' ';
+
+	return &set->glyphs[ch - TEXT_FIRST_GLYPH];
+}
+
+int textLineHeight(enum TextSize size) {
+	return sets[size].lineSkip;
+}
+
+/* Width of the widest line and height of all of them, unscaled */
+void textMeasure(enum TextSize size, const char *text, int *w, int *h) {
+	const struct GlyphSet *set = &sets[size];
+	int lineW = 0, maxW = 0, lines = 1;
+
+	for (const char *c = text; *c; c++) {
+		if (*c == '\n') {
+			maxW = SDL_max(maxW, lineW);
+			lineW = 0;
+			lines++;
+			continue;
+		}
+
+		lineW += glyphFor(set, *c)->advance;
+	}
+
+	*w = SDL_max(maxW, lineW);
+	*h = set->height + (lines - 1) * set->lineSkip;
+}
+
+/*
+** Adds the text to the current sprite batch at (x, y), every glyph scaled
+** by (sx, sy). Nothing appears until the batch is flushed.
+*/
+void textDrawScaled(enum TextSize size, const char *text, float x, float y,
+					float sx, float sy, SDL_Color color) {
+	if (!atlas)
+		return;
+
+	const struct GlyphSet *set = &sets[size];
+	float penX = x, penY = y;
+
+	for (const char *c = text; *c; c++) {
+		if (*c == '\n') {
+			penX = x;
+			penY += set->lineSkip * sy;
+			continue;
+		}
+
+		const struct Glyph *g = glyphFor(set, *c);
+		if (*c != ' ' && g->src.w) {
+			SDL_FRect dst = {penX, penY, g->src.w * sx, g->src.h * sy};
+			batchAddRegion(atlas, &g->src, &dst, color);
+		}
+
+		penX += g->advance * sx;
+	}
+}
+
+void textDraw(enum TextSize size, const char *text, int x, int y,
+			  SDL_Color color) {
+	textDrawScaled(size, text, (float)x, (float)y, 1.0f, 1.0f, color);
+}
+
+/* Stretched to fill the box, as labels always have been */
+void textDrawFit(enum TextSize size, const char *text, const SDL_Rect *box,
+				 SDL_Color color) {
+	int w, h;
+	textMeasure(size, text, &w, &h);
+	if (!w || !h)
+		return;
+
+	textDrawScaled(size, text, (float)box->x, (float)box->y,
+				   (float)box->w / w, (float)box->h / h, color);
+}
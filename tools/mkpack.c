@@ -0,0 +1,180 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Pack archive builder
+ *
+ * Usage: mkpack OUTPUT FILE...
+ * Each FILE is stored under the path it was given on the command line.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../pack.h"
+
+struct Input {
+	const char *name;
+	uint32_t nameLength;
+	unsigned char *data;
+	uint64_t size;
+	uint64_t offset;
+};
+
+static unsigned char *readFile(const char *path, uint64_t *size) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+
+	unsigned char *data = NULL;
+	size_t len = 0, cap = 0, got;
+
+	do {
+		if (len == cap) {
+			cap = cap ? cap * 2 : 65536;
+			unsigned char *grown = realloc(data, cap);
+			if (!grown) {
+				free(data);
+				fclose(fp);
+				return NULL;
+			}
+			data = grown;
+		}
+
+		got = fread(data + len, 1, cap - len, fp);
+		len += got;
+	} while (got);
+
+	if (ferror(fp)) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(fp);
+	*size = len;
+	return data;
+}
+
+static uint64_t alignUp(uint64_t n) {
+	return (n + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1);
+}
+
+static int writePadding(FILE *fp, uint64_t from, uint64_t to) {
+	static const char zeros[PACK_ALIGN];
+	return fwrite(zeros, 1, to - from, fp) == to - from;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		puts("Usage: mkpack OUTPUT FILE...");
+		return 1;
+	}
+
+	int count = argc - 2;
+	struct Input *inputs = calloc(count, sizeof(struct Input));
+
+	uint32_t buckets = 16;
+	while (buckets < (uint32_t)count * 2)
+		buckets *= 2;
+
+	struct PackEntry *table = calloc(buckets, sizeof(struct PackEntry));
+	int *owner = calloc(buckets, sizeof(int));
+	if (!inputs || !table || !owner) {
+		puts("E: Out of memory");
+		return 1;
+	}
+
+	uint64_t namesSize = 0;
+	for (int i = 0; i < count; i++) {
+		struct Input *in = &inputs[i];
+		in->name = argv[i + 2];
+		in->nameLength = (uint32_t)strlen(in->name);
+		in->data = readFile(in->name, &in->size);
+		if (!in->data) {
+			printf("E: Could not read \"%s\": %s\n", in->name,
+				   strerror(errno));
+			return 1;
+		}
+
+		namesSize += in->nameLength;
+	}
+
+	/* Lay out names after the table, then data after the names */
+	uint64_t namesStart =
+		sizeof(struct PackHeader) + sizeof(struct PackEntry) * buckets;
+	uint64_t cursor = alignUp(namesStart + namesSize);
+	uint64_t nameCursor = namesStart;
+
+	for (int i = 0; i < count; i++) {
+		struct Input *in = &inputs[i];
+		uint64_t hash = packHash(in->name, in->nameLength);
+		uint32_t b = (uint32_t)hash & (buckets - 1);
+
+		while (table[b].nameLength) {
+			if (table[b].hash == hash && table[b].nameLength == in->nameLength &&
+				!memcmp(inputs[owner[b]].name, in->name,
+						in->nameLength)) {
+				printf("E: \"%s\" given twice\n", in->name);
+				return 1;
+			}
+			b = (b + 1) & (buckets - 1);
+		}
+
+		in->offset = cursor;
+		cursor = alignUp(cursor + in->size);
+
+		table[b].hash = hash;
+		table[b].nameOffset = (uint32_t)nameCursor;
+		table[b].nameLength = in->nameLength;
+		table[b].offset = in->offset;
+		table[b].size = in->size;
+		owner[b] = i;
+
+		nameCursor += in->nameLength;
+	}
+
+	FILE *fp = fopen(argv[1], "wb");
+	if (!fp) {
+		printf("E: Could not create \"%s\": %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	struct PackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.byteOrder = PACK_BYTE_ORDER;
+	header.version = PACK_FILE_VERSION;
+	header.entryCount = (uint32_t)count;
+	header.bucketCount = buckets;
+
+	int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			 fwrite(table, sizeof(struct PackEntry), buckets, fp) == buckets;
+
+	for (int i = 0; ok && i < count; i++)
+		ok = fwrite(inputs[i].name, 1, inputs[i].nameLength, fp) ==
+			 inputs[i].nameLength;
+
+	uint64_t written = namesStart + namesSize;
+	for (int i = 0; ok && i < count; i++) {
+		ok = writePadding(fp, written, inputs[i].offset) &&
+			 fwrite(inputs[i].data, 1, inputs[i].size, fp) == inputs[i].size;
+		written = inputs[i].offset + inputs[i].size;
+	}
+
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	if (!ok) {
+		printf("E: Could not write \"%s\"\n", argv[1]);
+		remove(argv[1]);
+		return 1;
+	}
+
+	printf("Packed %i files (%llu bytes) into \"%s\"\n", count,
+		   (unsigned long long)cursor, argv[1]);
+	return 0;
+}
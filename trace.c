@@ -0,0 +1,204 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Chrome trace event export routines
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** When enabled with -t, every traceBegin/traceEnd pair is kept in memory
+** and written out on exit as Chrome trace event JSON, which Perfetto and
+** chrome://tracing can open directly.
+**
+** Each thread appends to its own buffer, found through an SDL thread-local
+** slot, so recording takes no locks and never waits on another thread.
+** A buffer is a chain of fixed chunks and never moves once written. New
+** buffers are pushed onto a global list with a compare-and-swap so the
+** exit handler can find them all. Names must be string literals or
+** otherwise outlive the program, as only the pointer is stored.
+*/
+#define TRACE_CHUNK_EVENTS 4096
+
+struct TraceEvent {
+	const char *name;
+	uint64_t time;
+	char phase;
+};
+
+struct TraceChunk {
+	int count;
+	struct TraceChunk *next;
+	struct TraceEvent events[TRACE_CHUNK_EVENTS];
+};
+
+struct TraceBuffer {
+	int tid;
+	const char *threadName;
+
+	struct TraceChunk *first;
+	struct TraceChunk *last;
+
+	struct TraceBuffer *next;
+};
+
+static bool tracing = false;
+static char *tracePath = NULL;
+static uint64_t traceStart = 0;
+
+static struct TraceBuffer *buffers = NULL;
+static SDL_atomic_t nextTid;
+
+static SDL_TLSID localBuffer = 0;
+
+static struct TraceChunk *traceNewChunk() {
+	struct TraceChunk *chunk = malloc(sizeof(struct TraceChunk));
+	if (!chunk) {
+		puts("E: Out of memory while recording trace");
+		exit(1);
+	}
+
+	chunk->count = 0;
+	chunk->next = NULL;
+	return chunk;
+}
+
+static struct TraceBuffer *traceLocalBuffer() {
+	struct TraceBuffer *local = SDL_TLSGet(localBuffer);
+	if (local)
+		return local;
+
+	struct TraceBuffer *buf = malloc(sizeof(struct TraceBuffer));
+	if (!buf) {
+		puts("E: Out of memory while recording trace");
+		exit(1);
+	}
+
+	buf->tid = SDL_AtomicAdd(&nextTid, 1) + 1;
+	buf->threadName = buf->tid == 1 ? "main" : NULL;
+	buf->first = buf->last = traceNewChunk();
+
+	/* Lock-free push onto the list the exit handler walks */
+	do {
+		buf->next = SDL_AtomicGetPtr((void **)&buffers);
+	} while (!SDL_AtomicCASPtr((void **)&buffers, buf->next, buf));
+
+	/* Buffers outlive their threads; the exit handler still needs them */
+	SDL_TLSSet(localBuffer, buf, NULL);
+	return buf;
+}
+
+static void traceRecord(const char *name, char phase) {
+	uint64_t now = SDL_GetPerformanceCounter();
+	struct TraceBuffer *buf = traceLocalBuffer();
+
+	if (buf->last->count == TRACE_CHUNK_EVENTS) {
+		buf->last->next = traceNewChunk();
+		buf->last = buf->last->next;
+	}
+
+	struct TraceEvent *ev = &buf->last->events[buf->last->count++];
+	ev->name = name;
+	ev->time = now;
+	ev->phase = phase;
+}
+
+bool traceEnabled() {
+	return tracing;
+}
+
+void traceBegin(const char *name) {
+	if (tracing)
+		traceRecord(name, 'B');
+}
+
+void traceEnd(const char *name) {
+	if (tracing)
+		traceRecord(name, 'E');
+}
+
+void traceThreadName(const char *name) {
+	if (tracing)
+		traceLocalBuffer()->threadName = name;
+}
+
+/*
+** Runs at exit. Other threads are expected to have been joined by now;
+** anything they record past this point is lost.
+*/
+void traceFlush() {
+	if (!tracing)
+		return;
+
+	tracing = false;
+
+	FILE *fp = fopen(tracePath, "w");
+	if (!fp) {
+		printf("W: Could not write trace to \"%s\"\n", tracePath);
+		return;
+	}
+
+	double usPerCount = 1e6 / SDL_GetPerformanceFrequency();
+	bool first = true;
+	long written = 0;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+
+	for (struct TraceBuffer *buf = SDL_AtomicGetPtr((void **)&buffers); buf;
+		 buf = buf->next) {
+		if (buf->threadName) {
+			fprintf(fp,
+					"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+					"\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+					first ? "" : ",\n", buf->tid, buf->threadName);
+			first = false;
+		}
+
+		for (struct TraceChunk *c = buf->first; c; c = c->next) {
+			for (int i = 0; i < c->count; i++) {
+				struct TraceEvent *ev = &c->events[i];
+				double ts = (ev->time - traceStart) * usPerCount;
+
+				fprintf(fp,
+						"%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+						"\"pid\":1,\"tid\":%i}",
+						first ? "" : ",\n", ev->name, ev->phase, ts, buf->tid);
+				first = false;
+				written++;
+			}
+		}
+	}
+
+	fputs("\n]}\n", fp);
+	fclose(fp);
+
+	printf("Wrote %li trace events to \"%s\"\n", written, tracePath);
+}
+
+void traceOpen(char *path) {
+	localBuffer = SDL_TLSCreate();
+	if (!localBuffer) {
+		printf("W: Could not set up tracing; no trace will be written\n"
+			   "Error message: %s\n",
+			   SDL_GetError());
+		return;
+	}
+
+	tracePath = path;
+	traceStart = SDL_GetPerformanceCounter();
+	tracing = true;
+
+	/* The thread that turns tracing on is the main thread */
+	traceLocalBuffer();
+
+	atexit(traceFlush);
+}
@@ -0,0 +1,243 @@
+/*
+ * Ethan Marshall's Tank Game
+ * Authored in Winter 2021 instead of a boring computing project
+ * Copyright 2021 - Ethan Marshall
+ *
+ * Widget animation routines
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "tank.h"
+
+/*
+** Every running animation is one entry in a flat array, and each menu
+** tick advances the lot in a single pass. Durations are in milliseconds
+** of game time, so an animation looks the same whatever the tick rate.
+**
+** A tween holds a pointer straight to the field it drives, worked out
+** once when it starts, plus how that field is stored. Finished tweens are
+** swept out after the pass, and only then are their completion hooks run,
+** so a hook is free to start the next animation in a chain.
+*/
+enum TweenKind { TWEEN_INT = 0, TWEEN_FLOAT = 1, TWEEN_BYTE = 2 };
+
+struct Tween {
+	struct Widget *widget;
+	void *target;
+	enum TweenKind kind;
+
+	float from, to;
+	float elapsed, duration;
+	enum Ease ease;
+
+	void (*onDone)(struct Widget *widget);
+};
+
+static struct Tween tweens[TWEEN_MAX];
+static int tweenCount = 0;
+
+static float ease(enum Ease curve, float t) {
+	switch (curve) {
+	case EASE_IN_QUAD:
+		return t * t;
+	case EASE_OUT_QUAD:
+		return t * (2 - t);
+	case EASE_IN_OUT_QUAD:
+		return t < 0.5f ? 2 * t * t : -1 + (4 - 2 * t) * t;
+	case EASE_OUT_CUBIC: {
+		float u = t - 1;
+		return u * u * u + 1;
+	}
+	case EASE_OUT_BACK: {
+		const float s = 1.70158f;
+		float u = t - 1;
+		return u * u * ((s + 1) * u + s) + 1;
+	}
+	default:
+		return t;
+	}
+}
+
+static float tweenRead(const struct Tween *tween) {
+	switch (tween->kind) {
+	case TWEEN_INT:
+		return (float)*(int *)tween->target;
+	case TWEEN_BYTE:
+		return (float)*(uint8_t *)tween->target;
+	default:
+		return *(float *)tween->target;
+	}
+}
+
+static void tweenWrite(const struct Tween *tween, float value) {
+	switch (tween->kind) {
+	case TWEEN_INT:
+		*(int *)tween->target = (int)lroundf(value);
+		break;
+	case TWEEN_BYTE:
+		*(uint8_t *)tween->target =
+			(uint8_t)SDL_max(0, SDL_min(255, lroundf(value)));
+		break;
+	default:
+		*(float *)tween->target = value;
+		break;
+	}
+}
+
+/* Where a widget keeps the property, and how; false if it has none */
+static bool tweenResolve(struct Tween *tween, enum TweenProperty property) {
+	struct Widget *widget = tween->widget;
+
+	if (property <= TWEEN_H) {
+		SDL_Rect *rect = widgetRect(widget);
+		if (!rect)
+			return false;
+
+		int *fields[] = {&rect->x, &rect->y, &rect->w, &rect->h};
+		tween->target = fields[property];
+		tween->kind = TWEEN_INT;
+		return true;
+	}
+
+	switch (widget->type) {
+	case WIDGET_IMAGE: {
+		struct Image *image = (struct Image *)widget;
+		if (property == TWEEN_ROTATION) {
+			tween->target = &image->rotation;
+			tween->kind = TWEEN_FLOAT;
+		} else {
+			tween->target = &image->alpha;
+			tween->kind = TWEEN_BYTE;
+		}
+		return true;
+	}
+	case WIDGET_PARTIAL_IMAGE: {
+		struct PartialImage *image = (struct PartialImage *)widget;
+		if (property == TWEEN_ROTATION) {
+			tween->target = &image->rotation;
+			tween->kind = TWEEN_FLOAT;
+		} else {
+			tween->target = &image->alpha;
+			tween->kind = TWEEN_BYTE;
+		}
+		return true;
+	}
+	case WIDGET_LABEL:
+		if (property != TWEEN_ALPHA)
+			return false;
+
+		tween->target = &((struct Label *)widget)->color[0].a;
+		tween->kind = TWEEN_BYTE;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+** Animates one property of a widget from wherever it is now to the given
+** value. Starting a tween on a property that is already animating takes
+** over from the old one, whose completion hook never runs.
+*/
+void tweenStart(struct Widget *widget, enum TweenProperty property, float to,
+				uint32_t ms, enum Ease curve,
+				void (*onDone)(struct Widget *widget)) {
+	struct Tween tween;
+	tween.widget = widget;
+	tween.to = to;
+	tween.elapsed = 0;
+	tween.duration = (float)ms;
+	tween.ease = curve;
+	tween.onDone = onDone;
+
+	if (!tweenResolve(&tween, property)) {
+		printf("W: Widget has no property %i to animate\n", property);
+		return;
+	}
+
+	tween.from = tweenRead(&tween);
+
+	for (int i = 0; i < tweenCount; i++) {
+		if (tweens[i].target == tween.target) {
+			tweens[i] = tween;
+			return;
+		}
+	}
+
+	/* Rather than lose an animation, jump straight to where it would end */
+	if (tweenCount == TWEEN_MAX || ms == 0) {
+		if (tweenCount == TWEEN_MAX)
+			puts("W: Too many animations running; skipping one");
+
+		tweenWrite(&tween, to);
+		widgetDirty(widget);
+		if (onDone)
+			onDone(widget);
+		return;
+	}
+
+	tweens[tweenCount++] = tween;
+}
+
+/* Stops everything animating the widget, without running any hooks */
+void tweenCancel(struct Widget *widget) {
+	for (int i = 0; i < tweenCount;) {
+		if (tweens[i].widget == widget)
+			tweens[i] = tweens[--tweenCount];
+		else
+			i++;
+	}
+}
+
+bool tweenRunning(struct Widget *widget) {
+	for (int i = 0; i < tweenCount; i++) {
+		if (tweens[i].widget == widget)
+			return true;
+	}
+
+	return false;
+}
+
+void tweensTick(float ms) {
+	struct Widget *finished[TWEEN_MAX];
+	void (*hooks[TWEEN_MAX])(struct Widget *widget);
+	int finishedCount = 0;
+
+	for (int i = 0; i < tweenCount; i++) {
+		struct Tween *tween = &tweens[i];
+
+		tween->elapsed += ms;
+		float t = tween->elapsed / tween->duration;
+		if (t > 1)
+			t = 1;
+
+		tweenWrite(tween, tween->from + (tween->to - tween->from) *
+											ease(tween->ease, t));
+
+		/* Moves are noticed by layout; rotation and fading aren't */
+		widgetDirty(tween->widget);
+	}
+
+	for (int i = 0; i < tweenCount;) {
+		if (tweens[i].elapsed < tweens[i].duration) {
+			i++;
+			continue;
+		}
+
+		if (tweens[i].onDone) {
+			finished[finishedCount] = tweens[i].widget;
+			hooks[finishedCount++] = tweens[i].onDone;
+		}
+
+		tweens[i] = tweens[--tweenCount];
+	}
+
+	for (int i = 0; i < finishedCount; i++)
+		hooks[i](finished[i]);
+}
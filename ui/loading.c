@@ -8,24 +8,51 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
-#include <SDL2/SDL_pixels.h>
+#include <SDL2/SDL.h>
 
 #include "../tank.h"
 #include "ui.h"
 
 extern struct Menu *currentMenu;
+extern struct LevelLoad levelLoad;
+extern struct SDL_Renderer *renderer;
 
 static struct Menu loader;
 
 static const struct SDL_Color cols[2] = {{255, 0, 0, 255}, {0, 0, 0, 0}};
 static struct Label text;
 
+static const SDL_Rect barBounds = {450, 260, 500, 24};
+
+static void textTick(struct Label *target) {
+	char buf[UI_LABEL_MAX_TEXT];
+	snprintf(buf, sizeof(buf), "Loading %3i%%",
+			 (int)(levelLoadProgress(&levelLoad) * 100));
+
+	labelSetText(target, buf);
+}
+
+/* Progress bar under the text, drawn fresh every frame */
+static void textFrame(struct Label *target) {
+	SDL_Rect bar = barBounds;
+	bar.w = (int)(barBounds.w * levelLoadProgress(&levelLoad));
+
+	SDL_SetRenderDrawColor(renderer, cols[0].r, cols[0].g, cols[0].b,
+						   cols[0].a);
+	SDL_RenderDrawRect(renderer, &barBounds);
+	SDL_RenderFillRect(renderer, &bar);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+
 void createLoaderMenu() {
 	menuInit(&loader);
 
-	labelInit(&text, "Loading...", cols[0], cols[1], 450, 70, 500, 150);
+	labelInit(&text, "Loading   0%", cols[0], cols[1], 450, 70, 500, 150);
+	text.onTick = textTick;
+	text.onFrame = textFrame;
 	menuAddLabel(&loader, &text);
 
 	currentMenu = &loader;
@@ -19,16 +19,19 @@ extern void startGame();
 extern struct Menu *currentMenu;
 extern char *name;
 
-static const struct SDL_Color titleColors[2] = {{196, 28, 4}, {0, 0, 0, 0}};
+/* Opaque, box and all, as TTF_RenderText_Shaded always drew it */
+static const struct SDL_Color titleColors[2] = {{196, 28, 4, 255},
+												{0, 0, 0, 255}};
 
 static const struct SDL_Color buttonColors[2] = {{204, 212, 195, 255},
 												 {255, 255, 255, 255}};
 
+/* Both grow in from nothing, the backdrop a little ahead of the tank */
 static const int tankMaxSize[2] = {380, 350};
+static const uint32_t tankGrowMs = 400;
 
 static const int tankBgMaxSize[2] = {300, 250};
-
-static bool playingIntro = true;
+static const uint32_t tankBgGrowMs = 300;
 
 static struct Menu mm;
 
@@ -55,32 +58,10 @@ void helpCallback() {
 	puts("E: Not implemented");
 }
 
-void runIntroAnimationCircle(struct Image *target) {
-	if (!playingIntro)
-		return;
-
-	if (target->location.w >= tankBgMaxSize[0] ||
-		target->location.h >= tankBgMaxSize[1]) {
-		playingIntro = false;
-		return;
-	}
-
-	target->location.w += 15;
-	target->location.h += 15;
-}
-
-void runIntroAnimationImage(struct Image *target) {
-	if (!playingIntro)
-		return;
-
-	if (target->location.w >= tankMaxSize[0] ||
-		target->location.h >= tankMaxSize[1]) {
-		playingIntro = false;
-		return;
-	}
-
-	target->location.w += 15;
-	target->location.h += 15;
+static void runIntroAnimation(struct Image *target, const int *size,
+							  uint32_t ms) {
+	tweenStart(&target->node, TWEEN_W, size[0], ms, EASE_OUT_CUBIC, NULL);
+	tweenStart(&target->node, TWEEN_H, size[1], ms, EASE_OUT_CUBIC, NULL);
 }
 
 void createMainMenu() {
@@ -90,11 +71,11 @@ void createMainMenu() {
 	menuAddLabel(&mm, &title);
 
 	imageInit(&logoBackdrop, "res/ui/mm/circle.png", 480, 180, 0, 0, 0);
-	logoBackdrop.onTick = &runIntroAnimationCircle;
+	runIntroAnimation(&logoBackdrop, tankBgMaxSize, tankBgGrowMs);
 	menuAddImage(&mm, &logoBackdrop);
 
 	imageInit(&logo, "res/tank.png", 520, 220, 0, 0, 0);
-	logo.onTick = &runIntroAnimationImage;
+	runIntroAnimation(&logo, tankMaxSize, tankGrowMs);
 	menuAddImage(&mm, &logo);
 
 	buttonInit(&startButton, "Play", buttonColors[0], buttonColors[1], 980, 600,
@@ -6,6 +6,7 @@
  * Menu definitions used for control testing
  */
 
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -20,29 +21,31 @@ static struct Label label;
 static struct Button button;
 static struct Image image;
 
-static const SDL_Color fg = {0, 0, 255};
-static const SDL_Color bg = {255, 0, 0};
+static const SDL_Color fg = {0, 0, 255, 255};
+static const SDL_Color bg = {255, 0, 0, 255};
 static const char *tex = "res/tank.png";
 
-static bool tankReverse = false;
+/* The same speeds the old per-tick version had at 60 ticks a second */
+static const int slideEnds[2] = {100, 1250};
+static const uint32_t slideMs = 19167;
+static const uint32_t spinMs = 600;
 
 /*
-** Used to test onFrame and onTick hooks
+** Used to test chained animations; each one starts the next as it ends
 */
-static void imageAnimUpdate(struct Image *target) {
-	target->rotation += 10;
+static void imageSlide(struct Widget *target) {
+	struct Image *img = (struct Image *)target;
+	int to = img->location.x >= slideEnds[1] ? slideEnds[0] : slideEnds[1];
 
-	if (tankReverse) {
-		if (target->location.x <= 100)
-			tankReverse = false;
+	tweenStart(target, TWEEN_X, to, slideMs, EASE_LINEAR, imageSlide);
+}
 
-		target->location.x--;
-	} else {
-		if (target->location.x >= 1250)
-			tankReverse = true;
+static void imageSpin(struct Widget *target) {
+	struct Image *img = (struct Image *)target;
+	img->rotation = fmodf(img->rotation, 360);
 
-		target->location.x++;
-	}
+	tweenStart(target, TWEEN_ROTATION, img->rotation + 360, spinMs,
+			   EASE_LINEAR, imageSpin);
 }
 
 /*
@@ -63,7 +66,8 @@ void createTestMenu() {
 	menuAddButton(&test, &button);
 
 	imageInit(&image, (char *)tex, 100, 300, 200, 200, 0);
-	image.onTick = &imageAnimUpdate;
+	imageSlide(&image.node);
+	imageSpin(&image.node);
 	menuAddImage(&test, &image);
 
 	currentMenu = &test;
@@ -17,9 +17,29 @@
 
 #include "tank.h"
 
-struct SDL_Surface *loadTexture(const char *texPath) {
-	SDL_Surface *image = IMG_Load(texPath);
+/*
+** Safe to call from any thread; a missing or broken image just gives
+** NULL, for the caller to report from wherever it can stop the game.
+*/
+struct SDL_Surface *decodeTexture(const char *texPath) {
+	SDL_Surface *cached = texCacheLoad(texPath);
+	if (cached)
+		return cached;
+
+	traceBegin("loadTexture");
+	SDL_RWops *rw = packOpenRW(texPath);
+	SDL_Surface *image = rw ? IMG_Load_RW(rw, 1) : NULL;
+	traceEnd("loadTexture");
+
+	if (!image)
+		return NULL;
+
+	return texCacheStore(texPath, image);
+}
 
+/* Main thread only, as a missing texture ends the game */
+struct SDL_Surface *loadTexture(const char *texPath) {
+	SDL_Surface *image = decodeTexture(texPath);
 	if (!image) {
 		printf("E: Missing texture detected: \"%s\"\n", texPath);
 		exit(-1);